@@ -2,10 +2,10 @@
 # rewrite with AT&T syntax by falcon <wuzhangjin@gmail.com> at 081012
 #
 # SYS_SIZE is the number of clicks (16 bytes) to be loaded.
-# 0x3000 is 0x30000 bytes = 196kB, more than enough for current
-# versions of linux
+# 0x4000 is 0x40000 bytes = 256kB, more than enough for current
+# versions of linux. Keep it in step with SYS_SIZE in tools/build.sh.
 #
-	.equ SYSSIZE, 0x3000
+	.equ SYSSIZE, 0x4000
 #
 #	bootsect.s		(C) 1991 Linus Torvalds
 #
@@ -47,6 +47,30 @@ _start:
 	int	$0x15
 	mov	%ax, %ds:2
 
+# Get the BIOS memory map (int 0x15, eax=0xe820) if there is one: up to
+# 16 entries of 20 bytes at 0x900a0, their number in the byte at 0x901e0.
+
+	movb	$0, %ds:0x1e0
+	mov	%ds, %ax
+	mov	%ax, %es
+	mov	$0x00a0, %di
+	xor	%ebx, %ebx
+e820_next:
+	mov	$0xe820, %eax
+	mov	$20, %ecx
+	mov	$0x534d4150, %edx	# "SMAP"
+	int	$0x15
+	jc	e820_done
+	cmp	$0x534d4150, %eax
+	jne	e820_done
+	incb	%ds:0x1e0
+	add	$20, %di
+	test	%ebx, %ebx
+	jz	e820_done
+	cmpb	$16, %ds:0x1e0
+	jb	e820_next
+e820_done:
+
 # Get video-card data:
 
 	mov	$0x0f, %ah
@@ -5,6 +5,7 @@
  */
 
 /* bitmap.c contains the code that handles the inode and block bitmaps */
+#include <errno.h>
 #include <string.h>
 
 #include <linux/sched.h>
@@ -44,34 +45,68 @@ __asm__ __volatile__ ("cld\n" \
 	:"=c" (__res):"c" (0),"S" (addr)); \
 __res;})
 
-void free_block(int dev, int block)
+/*
+ * free_blocks() frees a list of blocks of one device. The list is
+ * sorted first, so the bitmap blocks are gone through in order and
+ * the super block is only looked up once.
+ */
+void free_blocks(int dev, int * blocks, int n)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
+	int i,j,k,block;
 
 	if (!(sb = get_super(dev)))
 		panic("trying to free block on nonexistent device");
-	if (block < sb->s_firstdatazone || block >= sb->s_nzones)
-		panic("trying to free block not in datazone");
-	bh = get_hash_table(dev,block);
-	if (bh) {
-		if (bh->b_count != 1) {
-			printk("trying to free block (%04x:%d), count=%d\n",
-				dev,block,bh->b_count);
-			return;
+	for (i=1 ; i<n ; i++) {
+		block = blocks[i];
+		for (j=i ; j>0 && blocks[j-1]>block ; j--)
+			blocks[j] = blocks[j-1];
+		blocks[j] = block;
+	}
+	for (i=0 ; i<n ; i++) {
+		block = blocks[i];
+		if (block < sb->s_firstdatazone || block >= sb->s_nzones)
+			panic("trying to free block not in datazone");
+		for (k=0 ; k < 1<<sb->s_log_zone_size ; k++) {
+			journal_revoke(dev,(block<<sb->s_log_zone_size)+k);
+			bh = get_hash_table(dev,(block<<sb->s_log_zone_size)+k);
+			if (!bh)
+				continue;
+			if (bh->b_count != 1) {
+				printk("trying to free block (%04x:%d), count=%d\n",
+					dev,block,bh->b_count);
+				break;
+			}
+			bh->b_dirt=0;
+			bh->b_uptodate=0;
+			brelse(bh);
 		}
-		bh->b_dirt=0;
-		bh->b_uptodate=0;
-		brelse(bh);
+		if (k < 1<<sb->s_log_zone_size)
+			continue;
+		if (!journal_free(dev,block))
+			release_zone(sb,block);
 	}
+}
+
+/* clear the bit of a freed zone, see journal_free() */
+void release_zone(struct super_block * sb, int block)
+{
 	block -= sb->s_firstdatazone - 1 ;
 	if (clear_bit(block&8191,sb->s_zmap[block/8192]->b_data)) {
-		printk("block (%04x:%d) ",dev,block+sb->s_firstdatazone-1);
+		printk("block (%04x:%d) ",sb->s_dev,block+sb->s_firstdatazone-1);
 		panic("free_block: bit already cleared");
 	}
-	sb->s_zmap[block/8192]->b_dirt = 1;
+	journal_dirty(sb->s_zmap[block/8192]);
+}
+
+void free_block(int dev, int block)
+{
+	free_blocks(dev,&block,1);
 }
 
+// 注意new_block()/free_block()处理的是区段（zone）号，一个区段有
+// 2^s_log_zone_size个连续的数据块，第一个块的块号是zone<<s_log_zone_size。
 // 具体的创建工作是在new_block（）函数中进行的，内容包括两部分：
 // 1）将新建数据块对应的逻辑块位图置1。
 // 2）在缓冲区中为新建的数据块申请缓冲块，用以承载写入的内容
@@ -87,31 +122,37 @@ int new_block(int dev)
 	j = 8192;
 
     //以下是根据超级块中逻辑块位图信息，对新数据块的逻辑块位图进行设置
-	for (i=0 ; i<8 ; i++)
+repeat:
+	for (i=0 ; i<Z_MAP_SLOTS ; i++)
 		if ((bh=sb->s_zmap[i]))
 			if ((j=find_first_zero(bh->b_data))<8192)
 				break;
-	if (i>=8 || !bh || j>=8192)
+	if (i>=Z_MAP_SLOTS || !bh || j>=8192) {
+		if (sync_truncates(dev) || journal_commit(dev))
+			goto repeat;
 		return 0;
+	}
 
 	if (set_bit(j,bh->b_data))
 		panic("new_block: bit already set");
 
     //将逻辑块位图所在的缓冲块使用标记置1
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	j += i*8192 + sb->s_firstdatazone-1; //确定数据块逻辑块号
 	if (j >= sb->s_nzones)
 		return 0;
 
-    //在缓冲区中，为新的数据块申请一个空闲缓冲块
-	if (!(bh=getblk(dev,j)))
-		panic("new_block: cannot get block");
-	if (bh->b_count != 1)
-		panic("new block: count is != 1");
-	clear_block(bh->b_data); //将该逻辑块中数据清零
-	bh->b_uptodate = 1;      //设置为更新数据
-	bh->b_dirt = 1;          //设置为脏数据
-	brelse(bh);
+    //在缓冲区中，为新区段的每个数据块申请一个空闲缓冲块
+	for (i=0 ; i < 1<<sb->s_log_zone_size ; i++) {
+		if (!(bh=getblk(dev,(j<<sb->s_log_zone_size)+i)))
+			panic("new_block: cannot get block");
+		if (bh->b_count != 1)
+			panic("new block: count is != 1");
+		clear_block(bh->b_data); //将该逻辑块中数据清零
+		bh->b_uptodate = 1;      //设置为更新数据
+		bh->b_dirt = 1;          //设置为脏数据
+		brelse(bh);
+	}
 	return j;
 }
 
@@ -123,6 +164,7 @@ void free_inode(struct m_inode * inode)
 	if (!inode)
 		return;
 	if (!inode->i_dev) {
+		mark_inode_clean(inode);
 		memset(inode,0,sizeof(*inode));
 		return;
 	}
@@ -140,26 +182,30 @@ void free_inode(struct m_inode * inode)
 		panic("nonexistent imap in superblock");
 	if (clear_bit(inode->i_num&8191,bh->b_data))
 		printk("free_inode: bit already cleared.\n\r");
-	bh->b_dirt = 1;
+	journal_dirty(bh);
+	mark_inode_clean(inode);
 	memset(inode,0,sizeof(*inode));
 }
 
-struct m_inode * new_inode(int dev)
+/* on failure *error is ENFILE if the inode table is full, else ENOSPC */
+struct m_inode * new_inode(int dev, int * error)
 {
 	struct m_inode * inode;
 	struct super_block * sb;
 	struct buffer_head * bh;
 	int i,j;
 
-    //从inode_table[32]中获取空闲i节点
+    //从inode_table[NR_INODE]中获取空闲i节点
+	*error = ENFILE;
 	if (!(inode=get_empty_inode()))
 		return NULL;
+	*error = ENOSPC;
     //获取设备超级块
 	if (!(sb = get_super(dev)))
 		panic("new_inode with unknown device");
 	j = 8192;
     //根据超级块中inode位图信息，设置inode节点位图
-	for (i=0 ; i<8 ; i++)
+	for (i=0 ; i<I_MAP_SLOTS ; i++)
 		if ((bh=sb->s_imap[i]))
 			if ((j=find_first_zero(bh->b_data))<8192)
 				break;
@@ -171,14 +217,15 @@ struct m_inode * new_inode(int dev)
 		panic("new_inode: bit already set");
 
     //将缓冲块设置为脏数据
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	inode->i_count=1;
 	inode->i_nlinks=1;
 	inode->i_dev=dev;
+	inode->i_sb=sb;
 	inode->i_uid=current->euid;
 	inode->i_gid=current->egid;
-	inode->i_dirt=1;
 	inode->i_num = j + i*8192;
+	mark_inode_dirty(inode);
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
 	return inode;
 }
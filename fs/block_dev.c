@@ -20,6 +20,8 @@ int block_write(int dev, long * pos, char * buf, int count)
 	struct buffer_head * bh;
 	register char * p;
 
+	if (IS_TMPFS(dev))	/* its "blocks" are kernel memory */
+		return -ENXIO;
 	while (count>0) {
 		chars = BLOCK_SIZE - offset;
 		if (chars > count)
@@ -36,8 +38,8 @@ int block_write(int dev, long * pos, char * buf, int count)
 		*pos += chars;
 		written += chars;
 		count -= chars;
-		while (chars-->0)
-			*(p++) = get_fs_byte(buf++);
+		memcpy_fromfs(p,buf,chars);
+		buf += chars;
 		bh->b_dirt = 1;
 		brelse(bh);
 	}
@@ -53,6 +55,8 @@ int block_read(int dev, unsigned long * pos, char * buf, int count)
 	struct buffer_head * bh;
 	register char * p;
 
+	if (IS_TMPFS(dev))
+		return -ENXIO;
 	while (count>0) {
 		chars = BLOCK_SIZE-offset;
 		if (chars > count)
@@ -65,8 +69,8 @@ int block_read(int dev, unsigned long * pos, char * buf, int count)
 		*pos += chars;
 		read += chars;
 		count -= chars;
-		while (chars-->0)
-			put_fs_byte(*(p++),buf++);
+		memcpy_tofs(buf,p,chars);
+		buf += chars;
 		brelse(bh);
 	}
 	return read;
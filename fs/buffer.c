@@ -45,48 +45,42 @@ static inline void wait_on_buffer(struct buffer_head * bh)
 	sti();
 }
 
-int sys_sync(void)
+/*
+ * Buffers in the journal (b_journal != 0) may only be written in place
+ * once their transaction has been committed, see journal.c.
+ */
+static void write_dirty(int dev)
 {
 	int i;
 	struct buffer_head * bh;
 
-    //将inode写入缓冲区
-	sync_inodes();		/* write out inodes into buffers */
 	bh = start_buffer;
-
-    //遍历整个缓冲区
 	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-        //如果那个缓冲块正在使用，就等待这个缓冲块解锁
+		if (dev && bh->b_dev != dev)
+			continue;
 		wait_on_buffer(bh);
-        //如果该缓冲块是脏的
-		if (bh->b_dirt)
-			ll_rw_block(WRITE,bh); //将缓冲块的内容同步到外设中
+		if ((!dev || bh->b_dev == dev) && bh->b_dirt && !bh->b_journal)
+			ll_rw_block(WRITE,bh);
 	}
+}
+
+int sys_sync(void)
+{
+    //将inode写入缓冲区
+	sync_truncates(0);	/* free what truncd hasn't got to yet */
+	sync_inodes();		/* write out inodes into buffers */
+	journal_commit(0);
+    //遍历整个缓冲区，将脏的缓冲块同步到外设中
+	write_dirty(0);
 	return 0;
 }
 
 int sync_dev(int dev)
 {
-	int i;
-	struct buffer_head * bh;
-
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	write_dirty(dev);
 	sync_inodes();
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	journal_commit(dev);
+	write_dirty(dev);
 	return 0;
 }
 
@@ -169,7 +163,8 @@ static inline void insert_into_queues(struct buffer_head * bh)
 		return;
 	bh->b_next = hash(bh->b_dev,bh->b_blocknr);
 	hash(bh->b_dev,bh->b_blocknr) = bh;
-	bh->b_next->b_prev = bh;
+	if (bh->b_next)
+		bh->b_next->b_prev = bh;
 }
 
 static struct buffer_head * find_buffer(int dev, int block)
@@ -219,12 +214,43 @@ struct buffer_head * get_hash_table(int dev, int block)
  * 使用哈希表进行查询的目的是提高查询速度。
  *
  */
+/*
+ * A tmpfs has no blocks to cache: its block numbers are addresses in
+ * kernel memory (see tmpfs.c), and it gets buffer heads from this small
+ * pool that point straight at them. They are always uptodate, never on
+ * the hash or free lists, and brelse() works on them as usual.
+ */
+#define NR_PAGE_BH 16
+static struct buffer_head page_bh[NR_PAGE_BH];
+
+static struct buffer_head * page_getblk(int dev,int block)
+{
+	struct buffer_head * bh;
+
+	for (;;) {
+		for (bh = page_bh ; bh < page_bh+NR_PAGE_BH ; bh++)
+			if (!bh->b_count) {
+				bh->b_data = (char *) (block << BLOCK_SIZE_BITS);
+				bh->b_dev = dev;
+				bh->b_blocknr = block;
+				bh->b_uptodate = 1;
+				bh->b_dirt = 0;
+				bh->b_journal = 0;
+				bh->b_count = 1;
+				return bh;
+			}
+		sleep_on(&buffer_wait);
+	}
+}
+
 //第一次调用时，b_dirt、b_lock是0，BADNESS（bh）就是00
 #define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
 struct buffer_head * getblk(int dev,int block)
 {
 	struct buffer_head * tmp, * bh;
 
+	if (IS_TMPFS(dev))
+		return page_getblk(dev,block);
 repeat:
 	if ((bh = get_hash_table(dev,block)))
 		return bh;
@@ -249,7 +275,7 @@ repeat:
 
     //虽然找到了空闲缓冲块，但仍然是脏的，说明缓冲区已经无可用的缓冲块了，需要同步腾空缓冲块了
 	while (bh->b_dirt) {
-		sync_dev(bh->b_dev);
+		write_dirty(bh->b_dev);	/* not sync_dev(): we may be committing */
 		wait_on_buffer(bh);
 		if (bh->b_count)
 			goto repeat;
@@ -312,12 +338,13 @@ __asm__("cld\n\t" \
  * bread_page reads four buffers into memory at the desired address. It's
  * a function of its own, as there is some speed to be got by reading them
  * all at the same time, not waiting for one to be read, and then another
- * etc.
+ * etc. Holes (b[i] == 0) and blocks that could not be read come out as
+ * zeroes, so the page needn't be cleared beforehand.
  */
 void bread_page(unsigned long address,int dev,int b[4])
 {
 	struct buffer_head * bh[4];
-	int i;
+	int i,j;
 
 	for (i=0 ; i<4 ; i++)
 		if (b[i]) {
@@ -326,13 +353,56 @@ void bread_page(unsigned long address,int dev,int b[4])
 					ll_rw_block(READ,bh[i]);
 		} else
 			bh[i] = NULL;
-	for (i=0 ; i<4 ; i++,address += BLOCK_SIZE)
+	for (i=0 ; i<4 ; i++,address += BLOCK_SIZE) {
 		if (bh[i]) {
 			wait_on_buffer(bh[i]);
-			if (bh[i]->b_uptodate)
+			if (bh[i]->b_uptodate) {
 				COPYBLK((unsigned long) bh[i]->b_data,address);
+				brelse(bh[i]);
+				continue;
+			}
 			brelse(bh[i]);
 		}
+		for (j=0 ; j<BLOCK_SIZE/4 ; j++)
+			((unsigned long *) address)[j] = 0;
+	}
+}
+
+/*
+ * Are the blocks of a page all in the buffer cache, read in? Then
+ * bread_page() won't have to wait for them. Doesn't sleep.
+ */
+int page_in_cache(int dev,int b[4])
+{
+	struct buffer_head * bh;
+	int i;
+
+	if (IS_TMPFS(dev))
+		return 1;
+	for (i=0 ; i<4 ; i++)
+		if (b[i] && (!(bh = find_buffer(dev,b[i])) ||
+		    bh->b_lock || !bh->b_uptodate))
+			return 0;
+	return 1;
+}
+
+/*
+ * Start reading the blocks of a page, for bread_page() to find them in
+ * the cache later, but don't wait for them.
+ */
+void breada_page(int dev,int b[4])
+{
+	struct buffer_head * bh;
+	int i;
+
+	if (IS_TMPFS(dev))
+		return;
+	for (i=0 ; i<4 ; i++)
+		if (b[i] && (bh = getblk(dev,b[i]))) {
+			if (!bh->b_uptodate)
+				ll_rw_block(READA,bh);
+			bh->b_count--;
+		}
 }
 
 /*
@@ -354,7 +424,7 @@ struct buffer_head * breada(int dev,int first, ...)
 		tmp=getblk(dev,first);
 		if (tmp) {
 			if (!tmp->b_uptodate)
-				ll_rw_block(READA,bh);
+				ll_rw_block(READA,tmp);
 			tmp->b_count--;
 		}
 	}
@@ -386,6 +456,7 @@ void buffer_init(long buffer_end)
 		h->b_dirt = 0;
 		h->b_count = 0;
 		h->b_lock = 0;
+		h->b_journal = 0;
 		h->b_uptodate = 0;
 		h->b_wait = NULL;
 		h->b_next = NULL; //这两项初始化为空，后续的使用将与hash_table进行挂接
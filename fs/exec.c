@@ -171,7 +171,7 @@ static unsigned long change_ldt(unsigned long text_size,unsigned long * page)
 	for (i=MAX_ARG_PAGES-1 ; i>=0 ; i--) {
 		data_base -= PAGE_SIZE;
 		if (page[i])
-			put_page(page[i],data_base);
+			put_dirty_page(page[i],data_base);
 	}
 	return data_limit;
 }
@@ -218,8 +218,8 @@ restart_interp:
 		retval = -ENOEXEC;
 		goto exec_error2;
 	}
-    //通过inode，确定shell文件所在设备的设备号及其文件头的块号i_zone[0]获取文件头
-	if (!(bh = bread(inode->i_dev,inode->i_zone[0]))) {
+    //通过inode，确定shell文件所在设备的设备号及其文件头的块号（第0块）获取文件头
+	if (!(bh = bread(inode->i_dev,bmap(inode,0)))) {
 		retval = -EACCES;
 		goto exec_error2;
 	}
@@ -326,13 +326,15 @@ restart_interp:
 	current->executable = inode;
 	for (i=0 ; i<32 ; i++)
 		current->sigaction[i].sa_handler = NULL;
-	for (i=0 ; i<NR_OPEN ; i++)
-		if ((current->close_on_exec>>i)&1)
+	for (i=0 ; i<current->max_fds ; i++)
+		if (FD_ISSET(i,current->close_on_exec))
 			sys_close(i);
-	current->close_on_exec = 0; //并将close_on_exec所有位清零
-    //解除进程2与进程1共享的页面关系
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	exit_mmap();
+    //解除进程2与进程1共享的页面关系，vfork()借来的内存还给父进程
+	if (!release_vfork()) {
+		free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
+		free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	}
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
     //将进程2的数学协处理器的使用标志清零
@@ -18,24 +18,20 @@ extern int sys_close(int fd);
 static int dupfd(unsigned int fd, unsigned int arg)
 {
     //检测是否具备复制文件句柄的条件
-	if (fd >= NR_OPEN || !current->filp[fd])
+	int newfd;
+
+	if (fd >= current->max_fds || !current->filp[fd])
 		return -EBADF;
 
-	if (arg >= NR_OPEN)
+	if (arg >= NR_OPEN_MAX)
 		return -EINVAL;
 
-	while (arg < NR_OPEN)
-		if (current->filp[arg]) //在进程1的filp[20]中寻找空闲项（此时是第二项），以便复制
-			arg++;
-		else
-			break;
-	if (arg >= NR_OPEN)
-		return -EMFILE;
+	if ((newfd = get_unused_fd(arg)) < 0)
+		return newfd;
 
     //复制文件句柄，建立标准输出设备，并相应增加文件引用计数，f_count为2
-	current->close_on_exec &= ~(1<<arg);
-	(current->filp[arg] = current->filp[fd])->f_count++;
-	return arg;
+	(current->filp[newfd] = current->filp[fd])->f_count++;
+	return newfd;
 }
 
 int sys_dup2(unsigned int oldfd, unsigned int newfd)
@@ -55,18 +51,18 @@ int sys_fcntl(unsigned int fd, unsigned int cmd, unsigned long arg)
 {	
 	struct file * filp;
 
-	if (fd >= NR_OPEN || !(filp = current->filp[fd]))
+	if (fd >= current->max_fds || !(filp = current->filp[fd]))
 		return -EBADF;
 	switch (cmd) {
 		case F_DUPFD:
 			return dupfd(fd,arg);
 		case F_GETFD:
-			return (current->close_on_exec>>fd)&1;
+			return FD_ISSET(fd,current->close_on_exec);
 		case F_SETFD:
 			if (arg&1)
-				current->close_on_exec |= (1<<fd);
+				FD_SET(fd,current->close_on_exec);
 			else
-				current->close_on_exec &= ~(1<<fd);
+				FD_CLR(fd,current->close_on_exec);
 			return 0;
 		case F_GETFL:
 			return filp->f_flags;
@@ -14,6 +14,31 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
+/*
+ * bmap() through a one-entry cache in the file, so that a run of small
+ * reads or writes within one block does not walk the indirect blocks
+ * every time. truncate() bumps i_tgen, which is what invalidates it.
+ */
+static int file_bmap(struct m_inode * inode, struct file * filp,
+	int block, int create)
+{
+	int nr;
+
+	if (filp->f_cnr && filp->f_cblock == block &&
+	    filp->f_cgen == inode->i_tgen)
+		return filp->f_cnr;
+	if (create)
+		nr = create_block(inode,block);
+	else
+		nr = bmap(inode,block);
+	if (nr) {
+		filp->f_cblock = block;
+		filp->f_cnr = nr;
+		filp->f_cgen = inode->i_tgen;
+	}
+	return nr;
+}
+
 int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
 	int left,chars,nr;
@@ -22,7 +47,7 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 	if ((left=count)<=0)
 		return 0;
 	while (left) {
-		if ((nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE))) {
+		if ((nr = file_bmap(inode,filp,(filp->f_pos)/BLOCK_SIZE,0))) {
 			if (!(bh=bread(inode->i_dev,nr)))
 				break;
 		} else
@@ -32,16 +57,15 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 		filp->f_pos += chars;
 		left -= chars;
 		if (bh) {
-			char * p = nr + bh->b_data;
-			while (chars-->0)
-				put_fs_byte(*(p++),buf++);
+			memcpy_tofs(buf,nr + bh->b_data,chars);
+			buf += chars;
 			brelse(bh);
 		} else {
 			while (chars-->0)
 				put_fs_byte(0,buf++);
 		}
 	}
-	inode->i_atime = CURRENT_TIME;
+	update_atime(inode);
 	return (count-left)?(count-left):-ERROR;
 }
 
@@ -68,14 +92,18 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 
 	while (i<count) {
         //创建逻辑块，并返回块号（将新建数据块对应的逻辑块位图置1，在缓冲区中为新建的数据块申请缓冲块设置为脏和更新）
-		if (!(block = create_block(inode,pos/BLOCK_SIZE)))
+		if (!(block = file_bmap(inode,filp,pos/BLOCK_SIZE,1)))
 			break;
-        //申请缓冲块，不需要读出来
-		if (!(bh=bread(inode->i_dev,block)))
+		c = pos % BLOCK_SIZE;
+        //整块覆盖时只申请缓冲块，不需要读出来
+		if (!c && count-i >= BLOCK_SIZE) {
+			if (!(bh=getblk(inode->i_dev,block)))
+				break;
+			bh->b_uptodate = 1;
+		} else if (!(bh=bread(inode->i_dev,block)))
 			break;
 
         //开始计算向缓冲块写入字节数
-		c = pos % BLOCK_SIZE;
 		p = c + bh->b_data;
 		bh->b_dirt = 1;
 		c = BLOCK_SIZE-c;
@@ -83,12 +111,12 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 		pos += c;
 		if (pos > inode->i_size) {
 			inode->i_size = pos;
-			inode->i_dirt = 1;
+			mark_inode_dirty(inode);
 		}
 		i += c;
 		//计算结束，将数据写入指定的缓冲块
-        while (c-->0)
-			*(p++) = get_fs_byte(buf++);
+		memcpy_fromfs(p,buf,c);
+		buf += c;
 		brelse(bh);
 	}
 	inode->i_mtime = CURRENT_TIME;
@@ -4,6 +4,169 @@
  *  (C) 1991  Linus Torvalds
  */
 
-#include <linux/fs.h>
+#include <errno.h>
+#include <string.h>
 
-struct file file_table[NR_FILE];
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/kmem.h>
+
+/*
+ * struct files come from a kmem cache, so the table grows as files are
+ * opened, up to NR_FILE, and gives its memory back as they are closed.
+ */
+static struct kmem_cache filp_cache =
+	KMEM_CACHE("file",struct file,NULL,NULL,NR_FILE);
+
+struct file * get_empty_filp(void)
+{
+	struct file * f;
+
+	if ((f = (struct file *) kmem_cache_alloc(&filp_cache)))
+		f->f_count = 1;
+	return f;
+}
+
+void put_filp(struct file * f)
+{
+	f->f_count = 0;
+	kmem_cache_free(&filp_cache,f);
+}
+
+/*
+ * A task starts with the NR_OPEN fds in its task struct. Going past
+ * them moves filp[] and the open_fds and close_on_exec bitmaps to
+ * malloc()ed memory, doubling the size each time up to NR_OPEN_MAX.
+ */
+#define FD_TABLE(n) ((n)*sizeof (struct file *))
+#define FD_BITS(n) (2*(n)/8)
+
+static void inline_files(struct task_struct * p)
+{
+	p->filp = p->fd_array;
+	p->open_fds = p->fd_bits;
+	p->close_on_exec = p->fd_bits+1;
+	p->max_fds = NR_OPEN;
+}
+
+static int alloc_files(struct task_struct * p, int n)
+{
+	struct file ** filp;
+	unsigned long * bits;
+	int i;
+
+	if (!(filp = malloc(FD_TABLE(n))))
+		return -ENOMEM;
+	if (!(bits = malloc(FD_BITS(n)))) {
+		free_s(filp,FD_TABLE(n));
+		return -ENOMEM;
+	}
+	for (i=0 ; i<n ; i++)
+		filp[i] = NULL;
+	for (i=0 ; i<n/16 ; i++)
+		bits[i] = 0;
+	p->filp = filp;
+	p->open_fds = bits;
+	p->close_on_exec = bits + n/32;
+	p->max_fds = n;
+	return 0;
+}
+
+/* copy the first 'n' fds of a table to p, which has room for them */
+static void copy_fds(struct task_struct * p, struct file ** filp,
+	unsigned long * open_fds, unsigned long * close_on_exec, int n)
+{
+	memcpy(p->filp,filp,FD_TABLE(n));
+	memcpy(p->open_fds,open_fds,n/8);
+	memcpy(p->close_on_exec,close_on_exec,n/8);
+}
+
+/* make room for fd 'nr' in the current task */
+static int expand_files(unsigned int nr)
+{
+	struct file ** filp = current->filp;
+	unsigned long * open_fds = current->open_fds;
+	unsigned long * close_on_exec = current->close_on_exec;
+	int old = current->max_fds, n = old;
+	int error;
+
+	if (nr >= NR_OPEN_MAX)
+		return -EMFILE;
+	while (n <= nr)
+		n <<= 1;
+	if ((error = alloc_files(current,n)))
+		return error;
+	copy_fds(current,filp,open_fds,close_on_exec,old);
+	if (filp != current->fd_array) {
+		free_s(filp,FD_TABLE(old));
+		free_s(open_fds,FD_BITS(old));
+	}
+	return 0;
+}
+
+/*
+ * Reserve the lowest free fd >= start. The caller installs a file in
+ * filp[fd], or gives the fd back with put_unused_fd().
+ */
+int get_unused_fd(unsigned int start)
+{
+	unsigned long word;
+	unsigned int fd;
+	int error;
+
+	if ((fd = start) < current->next_fd)
+		fd = current->next_fd;
+	for (;;) {
+		if (fd >= current->max_fds && (error = expand_files(fd)))
+			return error;
+		if ((word = ~current->open_fds[fd>>5] >> (fd&31)))
+			break;
+		fd = (fd|31)+1;
+	}
+	while (!(word & 1)) {
+		word >>= 1;
+		fd++;
+	}
+	FD_SET(fd,current->open_fds);
+	FD_CLR(fd,current->close_on_exec);
+	if (start <= current->next_fd)
+		current->next_fd = fd+1;
+	return fd;
+}
+
+void put_unused_fd(unsigned int fd)
+{
+	FD_CLR(fd,current->open_fds);
+	FD_CLR(fd,current->close_on_exec);
+	if (fd < current->next_fd)
+		current->next_fd = fd;
+}
+
+/* fork(): the child gets a copy of the fd table of the current task */
+int copy_files(struct task_struct * p)
+{
+	if (current->filp == current->fd_array) {
+		inline_files(p);
+		return 0;
+	}
+	if (alloc_files(p,current->max_fds)) {
+		inline_files(p);
+		return -ENOMEM;
+	}
+	copy_fds(p,current->filp,current->open_fds,current->close_on_exec,
+		current->max_fds);
+	return 0;
+}
+
+/* exit(): all fds are closed, give back a malloc()ed table */
+void free_files(struct task_struct * p)
+{
+	if (p->filp != p->fd_array) {
+		free_s(p->filp,FD_TABLE(p->max_fds));
+		free_s(p->open_fds,FD_BITS(p->max_fds));
+	}
+	inline_files(p);
+	p->fd_bits[0] = p->fd_bits[1] = 0;
+	p->next_fd = 0;
+}
@@ -14,6 +14,14 @@
 
 struct m_inode inode_table[NR_INODE]={{0,},};
 
+/*
+ * Dirty inodes are kept on a list, so that sync doesn't have to look
+ * at the whole inode table. mark_inode_dirty() puts an inode on it,
+ * and write_inode() takes it off again, together with every other
+ * dirty inode that lives in the same disk block.
+ */
+static struct m_inode * dirty_inodes = NULL;
+
 static void read_inode(struct m_inode * inode);
 static void write_inode(struct m_inode * inode);
 
@@ -40,6 +48,56 @@ static inline void unlock_inode(struct m_inode * inode)
 	wake_up(&inode->i_wait);
 }
 
+void mark_inode_dirty(struct m_inode * inode)
+{
+	inode->i_dirt = 1;
+	if (inode->i_dpprev || !inode->i_dev || inode->i_pipe)
+		return;
+	if ((inode->i_dnext = dirty_inodes))
+		dirty_inodes->i_dpprev = &inode->i_dnext;
+	inode->i_dpprev = &dirty_inodes;
+	dirty_inodes = inode;
+}
+
+/*
+ * Called on every access instead of setting i_atime directly. Without
+ * mount flags the time is only set, as it always was, and goes out
+ * with the next write of the inode: then 1 is returned. Relatime mounts
+ * write it when it is older than the last change or a day, noatime
+ * mounts never touch it.
+ */
+int update_atime(struct m_inode * inode)
+{
+	struct super_block * sb;
+	unsigned long now = CURRENT_TIME;
+
+	if (!inode->i_dev || !(sb = get_super(inode->i_dev)) ||
+	    !(sb->s_flags & (MS_NOATIME|MS_RELATIME))) {
+		inode->i_atime = now;
+		return 1;
+	}
+	if (inode->i_atime == now || (sb->s_flags & MS_NOATIME))
+		return 0;
+	if (inode->i_atime > inode->i_mtime &&
+	    inode->i_atime > inode->i_ctime &&
+	    now - inode->i_atime < 24*60*60)
+		return 0;
+	inode->i_atime = now;
+	mark_inode_dirty(inode);
+	return 0;
+}
+
+void mark_inode_clean(struct m_inode * inode)
+{
+	inode->i_dirt = 0;
+	if (!inode->i_dpprev)
+		return;
+	if ((*inode->i_dpprev = inode->i_dnext))
+		inode->i_dnext->i_dpprev = inode->i_dpprev;
+	inode->i_dnext = NULL;
+	inode->i_dpprev = NULL;
+}
+
 void invalidate_inodes(int dev)
 {
 	int i;
@@ -51,119 +109,82 @@ void invalidate_inodes(int dev)
 		if (inode->i_dev == dev) {
 			if (inode->i_count)
 				printk("inode in use on removed disk\n\r");
-			inode->i_dev = inode->i_dirt = 0;
+			mark_inode_clean(inode);
+			inode->i_dev = 0;
 		}
 	}
 }
 
 void sync_inodes(void)
 {
-	int i;
 	struct m_inode * inode;
 
-	inode = 0+inode_table;
-    //遍历所有inode
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
-        //如果遍历到inode正在使用就等待indoe解锁
-		wait_on_inode(inode);
-        //如果inode节点内容已经被改动过，而且不是管道文件的inode
-		if (inode->i_dirt && !inode->i_pipe)
+    //只遍历脏inode链表，write_inode会把它（及同一块中的脏inode）摘下
+    //加锁的inode由持锁者写回：可能正是我们自己在write_inode中等缓冲块
+repeat:
+	for (inode = dirty_inodes ; inode ; inode = inode->i_dnext)
+		if (!inode->i_lock) {
 			write_inode(inode); //将inode 同步到缓冲区
-	}
+			goto repeat;
+		}
 }
 
+/*
+ * Blocks 0-6 are direct, then come one indirect, one double indirect
+ * and, on a v2 fs, one triple indirect tree in i_zone[7..9].
+ */
 static int _bmap(struct m_inode * inode,int block,int create)
 {
 	struct buffer_head * bh;
-	int i;
+	int v2 = inode->i_sb && inode->i_sb->s_version == 2;
+	int bits = IND_BITS(v2);
+	int log = inode->i_sb ? inode->i_sb->s_log_zone_size : 0;
+	int depth,i,nr,off;
 
     //如果待操作文件数块号小于0
 	if (block<0)
 		panic("_bmap: block<0");
-
-    //如果待操作文件数据块号大于允许的文件数据量最大值
-	if (block >= 7+512+512*512)
-		panic("_bmap: block>big");
-
-    //待操作数据块文件块号小于7
-	if (block<7) {
-        //如果是创建一个函数块
-		if (create && !inode->i_zone[block])
-			if ((inode->i_zone[block]=new_block(inode->i_dev))) {
-				inode->i_ctime=CURRENT_TIME;
-				inode->i_dirt=1;
-			}
-		return inode->i_zone[block];
+	if (IS_TMPFS(inode->i_dev))
+		return tmpfs_bmap(inode,block,create);
+
+    //区段(zone)可以包含2^log个块：先换算成区段号，off是块在区段内的偏移
+	off = block & ((1<<log)-1);
+	block >>= log;
+
+    //找出数据块位于哪一级间接块下，depth为0表示直接块
+	depth = 0;
+	if (block >= 7) {
+		block -= 7;
+		for (depth=1 ; block >= (1<<(bits*depth)) ; depth++) {
+			block -= 1<<(bits*depth);
+			if (depth == (v2?3:2))
+				panic("_bmap: block>big");
+		}
 	}
-	block -= 7;
-
-    //大于7、小于等于（7+512）个逻辑块的情况
-	if (block<512) {
-        //待操作数据块文件块号小于512，需要一级间接检索文件块号
-		if (create && !inode->i_zone[7])
-			if ((inode->i_zone[7]=new_block(inode->i_dev))) {
-				inode->i_dirt=1;
-				inode->i_ctime=CURRENT_TIME;
-			}
-        //一级间接块中没有索引号，无法继续查找，直接返回0
-		if (!inode->i_zone[7])
-			return 0;
-        //获取一级间接块
-		if (!(bh = bread(inode->i_dev,inode->i_zone[7])))
+	i = depth ? 6+depth : block;
+
+    //如果是创建一个数据块，且inode中的对应项为空
+	if (create && !inode->i_zone[i])
+		if ((inode->i_zone[i]=new_block(inode->i_dev))) {
+			inode->i_ctime=CURRENT_TIME;
+			mark_inode_dirty(inode);
+		}
+	nr = inode->i_zone[i];
+
+    //逐级读入间接块（只用区段的第一个块），取出下一级的区段号，必要时创建
+	while (nr && depth--) {
+		if (!(bh=bread(inode->i_dev,nr << log)))
 			return 0;
-        //取该间接块上第block项中的逻辑块
-		i = ((unsigned short *) (bh->b_data))[block];
-
-        //如果是创建一个新数据块，执行下面代码
-		if (create && !i)
-			if ((i=new_block(inode->i_dev))) {
-				((unsigned short *) (bh->b_data))[block]=i;
-				bh->b_dirt=1;
+		i = (block >> (bits*depth)) & ((1<<bits)-1);
+		nr = IND_ZONE(bh,i,v2);
+		if (create && !nr)
+			if ((nr=new_block(inode->i_dev))) {
+				SET_IND_ZONE(bh,i,v2,nr);
+				journal_dirty(bh);
 			}
 		brelse(bh);
-		return i;
 	}
-    //大于（7+512）、小于（7+512+512×512）个逻辑块的情况
-	block -= 512;
-	if (create && !inode->i_zone[8])
-		if ((inode->i_zone[8]=new_block(inode->i_dev))) {
-			inode->i_dirt=1;
-			inode->i_ctime=CURRENT_TIME;
-		}
-
-    //一级间接块中没有索引号，无法继续查找，直接返回0
-	if (!inode->i_zone[8])
-		return 0;
-
-    if (!(bh=bread(inode->i_dev,inode->i_zone[8]))) //获取一级间接块
-		return 0;
-
-    //取该间接块上第block/512项中的逻辑块号
-    i = ((unsigned short *)bh->b_data)[block>>9];
-	if (create && !i)
-		if ((i=new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block>>9]=i;
-			bh->b_dirt=1;
-		}
-	brelse(bh);
-	if (!i)
-		return 0;
-
-    //获取二级间接块
-	if (!(bh=bread(inode->i_dev,i)))
-		return 0;
-	i = ((unsigned short *)bh->b_data)[block&511];
-	if (create && !i)
-		if ((i=new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block&511]=i;
-			bh->b_dirt=1;
-		}
-    //create标志置位，不等于就要创建一个新数据块，必须确保文件的下一个文件块不存在，
-    // 即！inode-＞i_zone[……]或！i成立，才能创建新数据块。比如本实例中加载目录项的内容，
-    // 一个数据块中没有发现空闲项，很可能下一个数据块中就有，如果强行分配新数据块，
-    // 就会把已有的块覆盖掉，导致目录文件管理混乱。
-	brelse(bh);
-	return i;
+	return nr ? (nr << log) + off : 0;
 }
 
 int bmap(struct m_inode * inode,int block)
@@ -247,12 +268,8 @@ struct m_inode * get_empty_inode(void)
 					break;
 			}
 		}
-		if (!inode) {
-			for (i=0 ; i<NR_INODE ; i++)
-				printk("%04x: %6d\t",inode_table[i].i_dev,
-					inode_table[i].i_num);
-			panic("No free inodes in mem");
-		}
+		if (!inode)
+			return NULL;
 		wait_on_inode(inode);
 		while (inode->i_dirt) {
 			write_inode(inode);
@@ -333,24 +350,95 @@ struct m_inode * iget(int dev,int nr)
 	return inode;
 }
 
+/* where on the disk inode 'nr' lives, and its slot in that block */
+#define INODE_BLOCK(sb,nr) (IS_TMPFS((sb)->s_dev) ? tmpfs_inode_block(sb,nr) : \
+	2 + (sb)->s_imap_blocks + (sb)->s_zmap_blocks + \
+	((nr)-1)/((sb)->s_version == 2 ? V2_INODES_PER_BLOCK : INODES_PER_BLOCK))
+#define INODE_SLOT(sb,nr) (((nr)-1)% \
+	((sb)->s_version == 2 ? V2_INODES_PER_BLOCK : INODES_PER_BLOCK))
+
+static void d_to_m(struct m_inode * inode, struct buffer_head * bh,
+	struct super_block * sb)
+{
+	int i;
+
+	if (sb->s_version == 2) {
+		struct d2_inode * d = INODE_SLOT(sb,inode->i_num) +
+			(struct d2_inode *) bh->b_data;
+
+		inode->i_mode = d->i_mode;
+		inode->i_nlinks = d->i_nlinks;
+		inode->i_uid = d->i_uid;
+		inode->i_gid = d->i_gid;
+		inode->i_size = d->i_size;
+		inode->i_atime = d->i_atime;
+		inode->i_mtime = d->i_mtime;
+		inode->i_ctime = d->i_ctime;
+		for (i=0 ; i<10 ; i++)
+			inode->i_zone[i] = d->i_zone[i];
+	} else {
+		struct d_inode * d = INODE_SLOT(sb,inode->i_num) +
+			(struct d_inode *) bh->b_data;
+
+		inode->i_mode = d->i_mode;
+		inode->i_uid = d->i_uid;
+		inode->i_size = d->i_size;
+		inode->i_mtime = d->i_time;
+		inode->i_gid = d->i_gid;
+		inode->i_nlinks = d->i_nlinks;
+		for (i=0 ; i<9 ; i++)
+			inode->i_zone[i] = d->i_zone[i];
+		inode->i_zone[9] = 0;
+	}
+}
+
+static void m_to_d(struct m_inode * inode, struct buffer_head * bh,
+	struct super_block * sb)
+{
+	int i;
+
+	if (sb->s_version == 2) {
+		struct d2_inode * d = INODE_SLOT(sb,inode->i_num) +
+			(struct d2_inode *) bh->b_data;
+
+		d->i_mode = inode->i_mode;
+		d->i_nlinks = inode->i_nlinks;
+		d->i_uid = inode->i_uid;
+		d->i_gid = inode->i_gid;
+		d->i_size = inode->i_size;
+		d->i_atime = inode->i_atime;
+		d->i_mtime = inode->i_mtime;
+		d->i_ctime = inode->i_ctime;
+		for (i=0 ; i<10 ; i++)
+			d->i_zone[i] = inode->i_zone[i];
+	} else {
+		struct d_inode * d = INODE_SLOT(sb,inode->i_num) +
+			(struct d_inode *) bh->b_data;
+
+		d->i_mode = inode->i_mode;
+		d->i_uid = inode->i_uid;
+		d->i_size = inode->i_size;
+		d->i_time = inode->i_mtime;
+		d->i_gid = inode->i_gid;
+		d->i_nlinks = inode->i_nlinks;
+		for (i=0 ; i<9 ; i++)
+			d->i_zone[i] = inode->i_zone[i];
+	}
+}
+
 static void read_inode(struct m_inode * inode)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int block;
     //给参数inode加锁
 	lock_inode(inode);
 	if (!(sb=get_super(inode->i_dev)))
 		panic("trying to read inode without dev");
-	//通过inode所在的超级块，计算出inode所在的逻辑块号
-    block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-		(inode->i_num-1)/INODES_PER_BLOCK;
     //将inode所在的逻辑块整体读出，从中提取inode的信息，载入刚才加锁的inode位置上
-	if (!(bh=bread(inode->i_dev,block)))
+	if (!(bh=bread(inode->i_dev,INODE_BLOCK(sb,inode->i_num))))
 		panic("unable to read i-node block");
-	*(struct d_inode *)inode =
-		((struct d_inode *)bh->b_data)
-			[(inode->i_num-1)%INODES_PER_BLOCK];
+	d_to_m(inode,bh,sb);
+	inode->i_sb = sb;
     //释放缓冲块
 	brelse(bh);
     //解锁inode
@@ -361,11 +449,13 @@ static void write_inode(struct m_inode * inode)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
+	struct m_inode * p, * next;
 	int block;
 
     //先将inode加锁，保证写数据的原子性
 	lock_inode(inode);
 	if (!inode->i_dirt || !inode->i_dev) {
+		mark_inode_clean(inode);
 		unlock_inode(inode);
 		return;
 	}
@@ -373,21 +463,26 @@ static void write_inode(struct m_inode * inode)
     //获取外设超级块
 	if (!(sb=get_super(inode->i_dev)))
 		panic("trying to write inode without device");
-	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-		(inode->i_num-1)/INODES_PER_BLOCK; //确定inode位图在外设上的逻辑块号
+	block = INODE_BLOCK(sb,inode->i_num); //确定inode在外设上的逻辑块号
 
     //将inode所在的逻辑块加载入缓冲区
 	if (!(bh=bread(inode->i_dev,block)))
 		panic("unable to read i-node block");
 
     //将inode同步到缓冲区
-	((struct d_inode *)bh->b_data)
-		[(inode->i_num-1)%INODES_PER_BLOCK] =
-			*(struct d_inode *)inode;
+	m_to_d(inode,bh,sb);
+	mark_inode_clean(inode);
+    //同一块中其它未加锁的脏inode一并写入
+	for (p = dirty_inodes ; p ; p = next) {
+		next = p->i_dnext;
+		if (p->i_dev != inode->i_dev || p->i_lock ||
+		    INODE_BLOCK(sb,p->i_num) != block)
+			continue;
+		m_to_d(p,bh,sb);
+		mark_inode_clean(p);
+	}
     //缓冲块设置为脏
-	bh->b_dirt=1;
-    //将inode设置为0
-	inode->i_dirt=0;
+	journal_dirty(bh);
 	brelse(bh);
     //解锁inode
 	unlock_inode(inode);
@@ -0,0 +1,523 @@
+/*
+ *  linux/fs/journal.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * A write-ahead journal for minix fs metadata. It is optional: a file
+ * system has one if its root directory holds a regular file ".journal"
+ * of at least JOURNAL_MIN blocks, with no holes, made with e.g.
+ *
+ *	dd if=/dev/zero of=/.journal bs=1k count=512
+ *
+ * and it is picked up at the next mount. To fsck it is just a file.
+ *
+ * Bitmap, inode, directory and indirect blocks are marked dirty with
+ * journal_dirty(), which puts them in the running transaction and pins
+ * them: they are not written in place until the transaction has been
+ * committed, i.e. a descriptor block, a copy of each block and a
+ * commit block are in the journal, in that order. Commits happen in
+ * sync() and umount, right after sync_inodes(): that is between system
+ * calls, so what is committed is consistent. A transaction that gets
+ * near JOURNAL_MAX blocks sets journal_wanted, and the system call
+ * that did it calls journal_sync() on its way out. Only a single call
+ * that dirties more than the rest is committed in the middle, and a
+ * crash right after that still needs fsck. Once committed, the blocks
+ * are written back whenever the buffer cache likes.
+ *
+ * Transactions are appended after a header block. When the journal is
+ * full it is checkpointed: the logged copies are written in place and
+ * the journal starts over with a new header. Mounting does the same,
+ * which replays whatever was committed before a crash.
+ *
+ * A freed block that is in the journal gets a revoke record, so that a
+ * replay doesn't write an old copy over whatever it is used for now.
+ * And a freed zone stays allocated until the transaction that frees it
+ * is committed: file data is written in place at any time, and must
+ * not land in what is still an indirect or directory block on disk.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/system.h>
+
+extern void invalidate_inodes(int dev);
+
+#define JOURNAL_MAGIC	0x4a4e4c31	/* header: "JNL1" */
+#define DESC_MAGIC	0x4a4e4c44	/* descriptor */
+#define COMMIT_MAGIC	0x4a4e4c43	/* commit */
+
+#define JOURNAL_MAX	128	/* blocks in the running transaction */
+#define JOURNAL_WANT	(JOURNAL_MAX-32)	/* commit after this call */
+#define REVOKE_MAX	120	/* revokes in it, all fit in a descriptor */
+#define REVOKE_WANT	(REVOKE_MAX-16)
+#define FREE_MAX	(PAGE_SIZE/4)	/* zones freed in it */
+#define JOURNAL_MIN	(2*(JOURNAL_MAX+2)+1)
+#define FILTER_BITS	(PAGE_SIZE*8)
+
+struct journal_head {
+	unsigned long magic;
+	unsigned long seq;		/* of the first transaction */
+};
+
+struct journal_desc {
+	unsigned long magic;
+	unsigned long seq;
+	unsigned long nr_revoke;
+	unsigned long nr;
+	unsigned long block[1];		/* revokes, then logged blocks */
+};
+
+static struct journal {
+	struct super_block * sb;	/* NULL: slot is free */
+	struct m_inode * inode;
+	int size;			/* journal blocks */
+	int head;			/* where the next transaction goes */
+	unsigned long seq;		/* of the next transaction */
+	unsigned char lock;		/* commit or checkpoint going on */
+	struct task_struct * wait;
+	int nr, nr_revoke;		/* the running transaction */
+	struct buffer_head * bh[JOURNAL_MAX];
+	unsigned long revoke[REVOKE_MAX];
+	int nr_free;
+	unsigned long freed;		/* page: zones freed */
+	int ncommit;			/* the transaction being committed */
+	struct buffer_head * cbh[JOURNAL_MAX];
+	struct buffer_head * lbh[JOURNAL_MAX+1];	/* its journal blocks */
+	unsigned long filter;		/* page: bits of blocks in the log */
+} journal[NR_SUPER];
+
+int journal_wanted = 0;
+
+#define FILTER(j,b) ((unsigned long *) (j)->filter + ((b)%FILTER_BITS)/32)
+#define FILTER_BIT(b) (1UL << ((b)&31))
+
+static inline void wait_on_buffer(struct buffer_head * bh)
+{
+	cli();
+	while (bh->b_lock)
+		sleep_on(&bh->b_wait);
+	sti();
+}
+
+static struct journal * find_journal(int dev)
+{
+	struct journal * j;
+
+	for (j = journal ; j < journal+NR_SUPER ; j++)
+		if (j->sb && j->sb->s_dev == dev)
+			return j;
+	return NULL;
+}
+
+/* device block of journal block 'nr' */
+static int jblock(struct journal * j, int nr)
+{
+	return bmap(j->inode,nr);
+}
+
+static void write_wait(struct buffer_head ** bh, int n)
+{
+	int i;
+
+	for (i=0 ; i<n ; i++) {
+		bh[i]->b_uptodate = 1;
+		bh[i]->b_dirt = 1;
+		ll_rw_block(WRITE,bh[i]);
+	}
+	for (i=0 ; i<n ; i++)
+		wait_on_buffer(bh[i]);
+}
+
+static struct buffer_head * read_desc(struct journal * j, int pos,
+	unsigned long seq, unsigned long magic)
+{
+	struct buffer_head * bh;
+	struct journal_desc * d;
+
+	if (pos >= j->size || !(bh = bread(j->sb->s_dev,jblock(j,pos))))
+		return NULL;
+	d = (struct journal_desc *) bh->b_data;
+	if (d->magic == magic && d->seq == seq)
+		return bh;
+	brelse(bh);
+	return NULL;
+}
+
+/*
+ * Is 'block', logged in the transaction at 'pos', revoked later on:
+ * by a transaction after it or by the running one?
+ */
+static int revoked(struct journal * j, int pos, unsigned long seq, int block)
+{
+	struct buffer_head * bh;
+	struct journal_desc * d;
+	int i;
+
+	for (i=0 ; i<j->nr_revoke ; i++)
+		if (j->revoke[i] == block)
+			return 1;
+	while ((bh = read_desc(j,pos,seq,DESC_MAGIC))) {
+		d = (struct journal_desc *) bh->b_data;
+		pos += d->nr + 2;
+		seq++;
+		for (i=0 ; i<d->nr_revoke ; i++)
+			if (d->block[i] == block)
+				break;
+		brelse(bh);
+		if (i < d->nr_revoke)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Write every committed block in the journal in place, then start it
+ * over. When mounting, cached copies of the blocks are updated too: the
+ * bitmaps have been read already.
+ */
+static int checkpoint(struct journal * j, int mounting)
+{
+	struct buffer_head out;
+	struct buffer_head * bh, * desc, * cached;
+	struct journal_desc * d;
+	int dev = j->sb->s_dev;
+	int pos = 1, i, block, n = 0;
+	unsigned long seq = 0;
+
+	if ((bh = bread(dev,jblock(j,0))) &&
+	    ((struct journal_head *) bh->b_data)->magic == JOURNAL_MAGIC)
+		seq = ((struct journal_head *) bh->b_data)->seq;
+	brelse(bh);
+	out.b_wait = NULL;
+	out.b_lock = 0;
+	while (seq && (desc = read_desc(j,pos,seq,DESC_MAGIC))) {
+		d = (struct journal_desc *) desc->b_data;
+		if (!(bh = read_desc(j,pos+d->nr+1,seq,COMMIT_MAGIC))) {
+			brelse(desc);
+			break;
+		}
+		brelse(bh);
+		for (i=0 ; i<d->nr ; i++) {
+			block = d->block[d->nr_revoke+i];
+			if (revoked(j,pos+d->nr+2,seq+1,block))
+				continue;
+			if (!(bh = bread(dev,jblock(j,pos+1+i))))
+				continue;
+			if (mounting && (cached = get_hash_table(dev,block))) {
+				memcpy(cached->b_data,bh->b_data,BLOCK_SIZE);
+				cached->b_uptodate = 1;
+				brelse(cached);
+			}
+			out.b_data = bh->b_data;
+			out.b_dev = dev;
+			out.b_blocknr = block;
+			out.b_count = 1;
+			out.b_dirt = 1;
+			ll_rw_block(WRITE,&out);
+			wait_on_buffer(&out);
+			brelse(bh);
+		}
+		pos += d->nr + 2;
+		seq++;
+		n++;
+		brelse(desc);
+	}
+	if (seq > j->seq)
+		j->seq = seq;
+	if (!(bh = getblk(dev,jblock(j,0))))
+		panic("journal: no header");
+	((struct journal_head *) bh->b_data)->magic = JOURNAL_MAGIC;
+	((struct journal_head *) bh->b_data)->seq = j->seq;
+	write_wait(&bh,1);
+	brelse(bh);
+	j->head = 1;
+	for (i=0 ; i<FILTER_BITS/32 ; i++)
+		((unsigned long *) j->filter)[i] = 0;
+	return n;
+}
+
+/* returns the number of freed zones released */
+static int commit(struct journal * j)
+{
+	struct buffer_head * desc;
+	struct journal_desc * d;
+	int dev = j->sb->s_dev;
+	int i,n,k,freed;
+
+	while (j->lock)
+		sleep_on(&j->wait);
+	if (!j->nr && !j->nr_revoke && !j->nr_free)
+		return 0;
+/* the zone map goes in with the transaction that frees the zones */
+	for (freed = 0 ; j->nr_free && j->nr < JOURNAL_MAX ; freed++)
+		release_zone(j->sb,((unsigned long *) j->freed)[--j->nr_free]);
+	j->lock = 1;
+	n = j->nr;
+	if (j->head + n + 2 > j->size)
+		checkpoint(j,0);
+	for (i=0 ; i<=n ; i++)
+		j->lbh[i] = getblk(dev,jblock(j,j->head+1+i));
+	desc = getblk(dev,jblock(j,j->head));
+/* no sleeping from here until the copies are made */
+	if ((k = j->nr) > n)
+		k = n;
+	d = (struct journal_desc *) desc->b_data;
+	d->magic = DESC_MAGIC;
+	d->seq = j->seq;
+	d->nr_revoke = j->nr_revoke;
+	d->nr = k;
+	for (i=0 ; i<j->nr_revoke ; i++)
+		d->block[i] = j->revoke[i];
+	for (i=0 ; i<k ; i++) {
+		d->block[d->nr_revoke+i] = j->bh[i]->b_blocknr;
+		*FILTER(j,j->bh[i]->b_blocknr) |= FILTER_BIT(j->bh[i]->b_blocknr);
+		memcpy(j->lbh[i]->b_data,j->bh[i]->b_data,BLOCK_SIZE);
+		j->cbh[i] = j->bh[i];
+		j->cbh[i]->b_journal = (j->cbh[i]->b_journal & ~1) | 2;
+	}
+	j->ncommit = k;
+	for (i=k ; i<j->nr ; i++)
+		j->bh[i-k] = j->bh[i];
+	j->nr -= k;
+	j->nr_revoke = 0;
+	for (i=k+1 ; i<=n ; i++)
+		brelse(j->lbh[i]);
+	d = (struct journal_desc *) j->lbh[k]->b_data;
+	d->magic = COMMIT_MAGIC;
+	d->seq = j->seq;
+	d->nr_revoke = 0;
+	d->nr = k;
+/* descriptor and copies first, then the commit block */
+	write_wait(&desc,1);
+	write_wait(j->lbh,k);
+	write_wait(j->lbh+k,1);
+	j->head += k + 2;
+	j->seq++;
+	brelse(desc);
+	for (i=0 ; i<=k ; i++)
+		brelse(j->lbh[i]);
+	for (i=0 ; i<k ; i++) {
+		j->cbh[i]->b_journal &= ~2;
+		brelse(j->cbh[i]);
+	}
+	j->ncommit = 0;
+	j->lock = 0;
+	wake_up(&j->wait);
+	return freed;
+}
+
+/*
+ * Metadata buffers are marked dirty with this instead of b_dirt = 1,
+ * right after they have been changed.
+ */
+void journal_dirty(struct buffer_head * bh)
+{
+	struct journal * j;
+
+	bh->b_dirt = 1;
+	if ((bh->b_journal & 1) || !(j = find_journal(bh->b_dev)))
+		return;
+	bh->b_journal |= 1;		/* pinned from now on */
+	bh->b_count++;
+	while (j->nr >= JOURNAL_MAX)
+		commit(j);
+	j->bh[j->nr++] = bh;
+	if (j->nr >= JOURNAL_WANT)
+		journal_wanted = 1;
+}
+
+/*
+ * 'block' (not zone) of 'dev' is being freed: it leaves the running
+ * transaction, and gets a revoke record if it may be in the journal.
+ */
+void journal_revoke(int dev, int block)
+{
+	struct journal * j;
+	int i;
+
+	if (!(j = find_journal(dev)))
+		return;
+repeat:
+	for (i=0 ; i<j->nr ; i++)
+		if (j->bh[i]->b_blocknr == block) {
+			j->bh[i]->b_journal &= ~1;
+			brelse(j->bh[i]);
+			for (j->nr-- ; i<j->nr ; i++)
+				j->bh[i] = j->bh[i+1];
+			break;
+		}
+/* free_blocks() wants the only reference: wait for the commit */
+	for (i=0 ; i<j->ncommit ; i++)
+		if (j->cbh[i]->b_blocknr == block) {
+			sleep_on(&j->wait);
+			goto repeat;
+		}
+	if (!(*FILTER(j,block) & FILTER_BIT(block)))
+		return;
+	for (i=0 ; i<j->nr_revoke ; i++)
+		if (j->revoke[i] == block)
+			return;
+	while (j->nr_revoke >= REVOKE_MAX)
+		commit(j);
+	j->revoke[j->nr_revoke++] = block;
+	if (j->nr_revoke >= REVOKE_WANT)
+		journal_wanted = 1;
+}
+
+/*
+ * Zone 'block' of 'dev' is being freed. Returns 0 if the caller is to
+ * clear its bit now, 1 if it is left to the commit.
+ */
+int journal_free(int dev, int block)
+{
+	struct journal * j;
+
+	if (!(j = find_journal(dev)) || j->nr_free >= FREE_MAX)
+		return 0;
+	((unsigned long *) j->freed)[j->nr_free++] = block;
+	return 1;
+}
+
+/*
+ * Commit the running transaction of 'dev', of all devices if 0.
+ * new_block() uses the result to know if it is worth looking again.
+ */
+int journal_commit(int dev)
+{
+	struct journal * j;
+	int freed = 0;
+
+	for (j = journal ; j < journal+NR_SUPER ; j++)
+		if (j->sb && (!dev || j->sb->s_dev == dev))
+			freed += commit(j);
+	return freed;
+}
+
+/*
+ * system_call calls this after a system call that set journal_wanted:
+ * the inodes go in with the rest, like in sync().
+ */
+void journal_sync(void)
+{
+	journal_wanted = 0;
+	sync_inodes();
+	journal_commit(0);
+}
+
+/* the inode of /.journal, if there is one */
+static struct m_inode * find_journal_inode(int dev)
+{
+	struct m_inode * dir;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	int i,block,ino = 0;
+
+	if (!(dir = iget(dev,ROOT_INO)))
+		return NULL;
+	for (i=0 ; !ino && i < dir->i_size/sizeof (struct dir_entry) ; i++) {
+		if (!(i % DIR_ENTRIES_PER_BLOCK) &&
+		    (!(block = bmap(dir,i/DIR_ENTRIES_PER_BLOCK)) ||
+		    !(bh = bread(dev,block)))) {
+			i += DIR_ENTRIES_PER_BLOCK-1;
+			continue;
+		}
+		de = i % DIR_ENTRIES_PER_BLOCK + (struct dir_entry *) bh->b_data;
+		if (de->inode && !strcmp(de->name,".journal"))
+			ino = de->inode;
+		if (ino || !((i+1) % DIR_ENTRIES_PER_BLOCK))
+			brelse(bh);
+	}
+	iput(dir);
+	return ino ? iget(dev,ino) : NULL;
+}
+
+/*
+ * Called at the end of read_super(): replay the journal, and use it
+ * from now on.
+ */
+void journal_mount(struct super_block * sb)
+{
+	struct journal * j;
+	struct m_inode * inode;
+	struct buffer_head * bh;
+	int i,ino;
+
+	if (IS_TMPFS(sb->s_dev) || !(inode = find_journal_inode(sb->s_dev)))
+		return;
+	for (j = journal ; j < journal+NR_SUPER ; j++)
+		if (!j->sb)
+			break;
+	if (!S_ISREG(inode->i_mode) || inode->i_size < JOURNAL_MIN*BLOCK_SIZE ||
+	    !(j->filter = get_free_page())) {
+		printk("journal on %04x not used\n\r",sb->s_dev);
+		iput(inode);
+		return;
+	}
+	if (!(j->freed = get_free_page())) {
+		free_page(j->filter);
+		iput(inode);
+		return;
+	}
+	j->inode = inode;
+	j->size = inode->i_size / BLOCK_SIZE;
+	for (i=0 ; i<j->size ; i++)
+		if (!jblock(j,i)) {
+			printk("journal on %04x has holes\n\r",sb->s_dev);
+			iput(inode);
+			free_page(j->filter);
+			free_page(j->freed);
+			return;
+		}
+	j->sb = sb;
+	j->seq = 1;
+	j->nr = j->nr_revoke = j->ncommit = j->nr_free = 0;
+	if ((bh = bread(sb->s_dev,jblock(j,0))) &&
+	    ((struct journal_head *) bh->b_data)->magic == JOURNAL_MAGIC)
+		j->seq = ((struct journal_head *) bh->b_data)->seq;
+	brelse(bh);
+	j->lock = 1;
+	if ((i = checkpoint(j,1)))
+		printk("journal on %04x: %d transactions replayed\n\r",
+			sb->s_dev,i);
+	j->lock = 0;
+/* inodes read before the replay may be stale */
+	ino = inode->i_num;
+	iput(inode);
+	invalidate_inodes(sb->s_dev);
+	if (!(j->inode = iget(sb->s_dev,ino))) {
+		printk("journal on %04x not used\n\r",sb->s_dev);
+		free_page(j->filter);
+		free_page(j->freed);
+		j->sb = NULL;
+		return;
+	}
+	sb->s_journal = j->inode;
+}
+
+/* umount: everything is written in place, the journal is left empty */
+void journal_umount(struct super_block * sb)
+{
+	struct journal * j;
+
+	if (!(j = find_journal(sb->s_dev)))
+		return;
+	while (j->nr || j->nr_revoke || j->nr_free)
+		commit(j);
+	j->lock = 1;
+	checkpoint(j,0);
+	j->lock = 0;
+	wake_up(&j->wait);
+	iput(j->inode);
+	free_page(j->filter);
+	free_page(j->freed);
+	j->inode = NULL;
+	j->sb = NULL;
+	sb->s_journal = NULL;
+}
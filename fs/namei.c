@@ -77,6 +77,369 @@ static int match(int len,const char * name,struct dir_entry * de)
 	return same;
 }
 
+/*
+ * Large directories get an in-core name index. The first lookup in a
+ * directory of more than DIR_HASH_MIN entries reads the whole of it once
+ * and hashes every live name; after that a hit costs one block read and
+ * a miss (the common case for O_CREAT) costs nothing. Hits are always
+ * checked against the real entry, so the index is only a hint, but it
+ * must hold every name: add_entry() and del_entry() keep it in step.
+ *
+ * Up to NR_DH directories have an index each: a page of hash chains and
+ * as many pages of entries as the directory needs. When the pages of
+ * all indexes reach DH_MAX_PAGES, or there is no free page, the least
+ * recently used index is dropped. An index belongs to a device and
+ * inode number, not to an in-core inode, so it outlives the inode being
+ * reused for something else: it is dropped when the directory is
+ * removed or its device unmounted. dir->i_dhash remembers the slot. A
+ * directory that can't get an index keeps a slot marked as failed, and
+ * is searched linearly until some index pages have been given back.
+ *
+ * Minix has nowhere to hang an index on disk (a block not reachable
+ * from an inode is just taken back by fsck), so it lives in core only.
+ */
+#define DIR_HASH_MIN	(2*DIR_ENTRIES_PER_BLOCK)
+#define NR_DH		16
+#define DH_MAX_PAGES	256	/* 1MB, 40000 names or so */
+#define DH_CHAINS	(PAGE_SIZE/sizeof (struct dh_entry *))
+#define DH_PER_PAGE	((PAGE_SIZE-sizeof (long))/sizeof (struct dh_entry))
+
+struct dh_entry {
+	struct dh_entry * next;
+	unsigned long nr;
+	char name[NAME_LEN];
+};
+
+struct dh_dir {
+	unsigned short dev, num;	/* owner, dev 0 if the slot is free */
+	unsigned long lru;
+	int busy;			/* being built */
+	int users;			/* lookups sleeping on a block */
+	int changed;			/* names came or went meanwhile */
+	int failed;			/* no room: dh_freed at the time */
+	unsigned long freed;
+	int nr_pages;
+	struct dh_entry ** chains;	/* a page of hash chains */
+	unsigned long pages;		/* entry pages, linked by first word */
+	struct dh_entry * free;
+};
+
+static struct dh_dir dh_dirs[NR_DH];
+static int dh_pages = 0;
+static unsigned long dh_clock = 0;
+static unsigned long dh_freed = 0;	/* index pages were given back */
+
+static int dh_hashfn(const char * name)
+{
+	unsigned long h = 0;
+	int i;
+
+	for (i=0 ; i<NAME_LEN && name[i] ; i++)
+		h = (h << 4) + (h >> 28) + (unsigned char) name[i];
+	return h % DH_CHAINS;
+}
+
+static int dh_same(struct dh_entry * e, const char * name)
+{
+	int i;
+
+	for (i=0 ; i<NAME_LEN ; i++)
+		if (e->name[i] != name[i])
+			return 0;
+		else if (!name[i])
+			break;
+	return 1;
+}
+
+#define dh_owns(d,dir) ((d)->dev == (dir)->i_dev && (d)->num == (dir)->i_num)
+
+/* the index of a directory, complete or being built, or NULL */
+static struct dh_dir * dh_of(struct m_inode * dir)
+{
+	struct dh_dir * d;
+
+	if (dir->i_dhash >= 1 && dir->i_dhash <= NR_DH &&
+	    dh_owns(dh_dirs + dir->i_dhash - 1,dir))
+		return dh_dirs + dir->i_dhash - 1;
+	for (d = dh_dirs ; d < dh_dirs+NR_DH ; d++)
+		if (dh_owns(d,dir)) {
+			dir->i_dhash = d - dh_dirs + 1;
+			return d;
+		}
+	return NULL;
+}
+
+static void dh_release(struct dh_dir * d)
+{
+	unsigned long page;
+
+	while ((page = d->pages)) {
+		d->pages = *(unsigned long *) page;
+		free_page(page);
+	}
+	if (d->chains)
+		free_page((unsigned long) d->chains);
+	if (d->nr_pages)
+		dh_freed++;
+	dh_pages -= d->nr_pages;
+	d->nr_pages = 0;
+	d->chains = NULL;
+	d->free = NULL;
+	d->busy = 0;
+}
+
+/* disown an index; its pages go when nobody is using it any more */
+static void dh_drop(struct dh_dir * d)
+{
+	d->dev = d->num = 0;
+	if (!d->busy && !d->users)
+		dh_release(d);
+}
+
+/* a directory is removed, or (nr == 0) a device unmounted */
+void forget_dir_index(int dev, int nr)
+{
+	struct dh_dir * d;
+
+	for (d = dh_dirs ; d < dh_dirs+NR_DH ; d++)
+		if (d->dev == dev && (!nr || d->num == nr))
+			dh_drop(d);
+}
+
+/* a page for index 'd', dropping other indexes if need be */
+static unsigned long dh_get_page(struct dh_dir * d)
+{
+	struct dh_dir * p, * lru;
+	unsigned long page;
+
+	for (;;) {
+		if (dh_pages < DH_MAX_PAGES && (page = get_free_page())) {
+			dh_pages++;
+			d->nr_pages++;
+			return page;
+		}
+		lru = NULL;
+		for (p = dh_dirs ; p < dh_dirs+NR_DH ; p++)
+			if (p != d && p->nr_pages && !p->busy && !p->users &&
+			    (!lru || p->lru < lru->lru))
+				lru = p;
+		if (!lru)
+			return 0;
+		dh_drop(lru);
+	}
+}
+
+static struct dh_entry * dh_new_entry(struct dh_dir * d)
+{
+	struct dh_entry * e;
+	unsigned long page;
+	int i;
+
+	if (!d->free) {
+		if (!(page = dh_get_page(d)))
+			return NULL;
+		*(unsigned long *) page = d->pages;
+		d->pages = page;
+		e = (struct dh_entry *) (page + sizeof (long));
+		for (i=0 ; i<DH_PER_PAGE ; i++,e++) {
+			e->next = d->free;
+			d->free = e;
+		}
+	}
+	e = d->free;
+	d->free = e->next;
+	return e;
+}
+
+static struct dh_entry * dh_lookup(struct dh_dir * d, const char * name)
+{
+	struct dh_entry * e;
+
+	for (e = d->chains[dh_hashfn(name)] ; e ; e = e->next)
+		if (dh_same(e,name))
+			return e;
+	return NULL;
+}
+
+static void dh_remove(struct dh_dir * d, const char * name)
+{
+	struct dh_entry ** p;
+	struct dh_entry * e;
+
+	for (p = d->chains+dh_hashfn(name) ; (e = *p) ; p = &e->next)
+		if (dh_same(e,name)) {
+			*p = e->next;
+			e->next = d->free;
+			d->free = e;
+			return;
+		}
+}
+
+static int dh_insert(struct dh_dir * d, const char * name, unsigned long nr)
+{
+	struct dh_entry * e;
+	int h, i;
+
+	if (!(e = dh_new_entry(d)))
+		return 0;
+	e->nr = nr;
+	for (i=0 ; i<NAME_LEN && name[i] ; i++)
+		e->name[i] = name[i];
+	for ( ; i<NAME_LEN ; i++)
+		e->name[i] = 0;
+	h = dh_hashfn(e->name);
+	e->next = d->chains[h];
+	d->chains[h] = e;
+	return 1;
+}
+
+/* a name came into or went out of 'dir' */
+static void dh_update(struct m_inode * dir, const char * name,
+	unsigned long nr, int add)
+{
+	struct dh_dir * d;
+
+	if (!(d = dh_of(dir)))
+		return;
+	if (d->busy)
+		d->changed = 1;
+	else if (d->failed)
+		return;
+	else if (!add)
+		dh_remove(d,name);
+	else if (!dh_insert(d,name,nr)) {
+		if (!d->users)
+			dh_release(d);
+		d->failed = 1;
+		d->freed = dh_freed;
+	}
+}
+
+/* a slot for a new index: a free one, else the least recently used */
+static struct dh_dir * dh_slot(void)
+{
+	struct dh_dir * d, * lru = NULL;
+
+	for (d = dh_dirs ; d < dh_dirs+NR_DH ; d++) {
+		if (d->busy || d->users)
+			continue;
+		if (!d->dev) {
+			lru = d;
+			break;
+		}
+		if (!lru || d->lru < lru->lru)
+			lru = d;
+	}
+	if (lru)
+		dh_release(lru);
+	return lru;
+}
+
+static void dh_build(struct m_inode * dir)
+{
+	int entries, block, i;
+	struct dh_dir * d;
+	struct dh_entry * e;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+
+	if ((d = dh_of(dir))) {
+		if (d->busy || d->users)
+			return;
+		dh_release(d);
+	} else if ((d = dh_slot())) {
+		d->dev = dir->i_dev;
+		d->num = dir->i_num;
+		dir->i_dhash = d - dh_dirs + 1;
+	} else
+		return;
+	d->busy = 1;
+	d->failed = 0;
+	if (!(d->chains = (struct dh_entry **) dh_get_page(d)))
+		goto failed;
+repeat:
+	for (i=0 ; i<DH_CHAINS ; i++)
+		while ((e = d->chains[i])) {
+			d->chains[i] = e->next;
+			e->next = d->free;
+			d->free = e;
+		}
+	d->changed = 0;
+	entries = dir->i_size / (sizeof (struct dir_entry));
+	for (i=0 ; i<entries ; i += DIR_ENTRIES_PER_BLOCK) {
+		if (!(block = bmap(dir,i/DIR_ENTRIES_PER_BLOCK)) ||
+		    !(bh = bread(dir->i_dev,block)))
+			continue;
+		de = (struct dir_entry *) bh->b_data;
+		for (block=0 ; block<DIR_ENTRIES_PER_BLOCK &&
+		    i+block<entries ; block++,de++) {
+			if (!de->inode)
+				continue;
+			if (!dh_insert(d,de->name,i+block)) {
+				brelse(bh);
+				goto failed;
+			}
+		}
+		brelse(bh);
+	}
+	if (d->changed)
+		goto repeat;
+	d->busy = 0;
+	d->lru = ++dh_clock;
+	if (!d->dev)
+		dh_release(d);
+	return;
+failed:
+	dh_release(d);
+	d->failed = 1;
+	d->freed = dh_freed;
+	d->lru = ++dh_clock;
+}
+
+/*
+ * look a name up in a complete index, dropping it if it is stale. Reading
+ * the block may sleep, and the index may change meanwhile: d->users
+ * keeps it from being dropped, and the entry is looked up again.
+ */
+static struct buffer_head * dh_find(struct m_inode * dir, struct dh_dir * d,
+	const char * name, int namelen, struct dir_entry ** res_dir,
+	int * res_nr)
+{
+	struct dh_entry * e;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	unsigned long nr;
+	int block, i;
+
+	d->lru = ++dh_clock;
+	d->users++;
+	while ((e = dh_lookup(d,name))) {
+		nr = e->nr;
+		if (nr < dir->i_size / sizeof (struct dir_entry) &&
+		    (block = bmap(dir,nr/DIR_ENTRIES_PER_BLOCK)) &&
+		    (bh = bread(dir->i_dev,block))) {
+			de = nr % DIR_ENTRIES_PER_BLOCK +
+				(struct dir_entry *) bh->b_data;
+			for (i=0 ; i<namelen ; i++)
+				if (de->name[i] != name[i])
+					break;
+			if (de->inode && i == namelen &&
+			    (namelen == NAME_LEN || !de->name[namelen])) {
+				d->users--;
+				*res_dir = de;
+				if (res_nr)
+					*res_nr = nr;
+				return bh;
+			}
+			brelse(bh);
+		}
+		if ((e = dh_lookup(d,name)) && e->nr == nr)
+			dh_remove(d,name);
+	}
+	d->users--;
+	return NULL;
+}
+
 /*
  *	find_entry()
  *
@@ -89,13 +452,16 @@ static int match(int len,const char * name,struct dir_entry * de)
  * over a pseudo-root and a mount point.
  */
 static struct buffer_head * find_entry(struct m_inode ** dir,
-	const char * name, int namelen, struct dir_entry ** res_dir)
+	const char * name, int namelen, struct dir_entry ** res_dir,
+	int * res_nr)
 {
 	int entries;
 	int block,i;
 	struct buffer_head * bh;
 	struct dir_entry * de;
 	struct super_block * sb;
+	struct dh_dir * d;
+	char kname[NAME_LEN];
 
 #ifdef NO_TRUNCATE
 	if (namelen > NAME_LEN)
@@ -124,7 +490,17 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 			}
 		}
 	}
-	if (!(block = (*dir)->i_zone[0]))
+	if (entries > DIR_HASH_MIN) {
+		for (i=0 ; i<NAME_LEN ; i++)
+			kname[i] = (i<namelen)?get_fs_byte(name+i):0;
+		if (!(d = dh_of(*dir)) || (d->failed && d->freed != dh_freed)) {
+			dh_build(*dir);
+			d = dh_of(*dir);
+		}
+		if (d && !d->busy && !d->failed)
+			return dh_find(*dir,d,kname,namelen,res_dir,res_nr);
+	}
+	if (!(block = bmap(*dir,0)))
 		return NULL;
 	if (!(bh = bread((*dir)->i_dev,block)))
 		return NULL;
@@ -149,6 +525,8 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
         //目录项匹配确认
 		if (match(namelen,name,de)) {
 			*res_dir = de; //如果找到了目标目录项，就交给*res_dir指针
+			if (res_nr)
+				*res_nr = i;
 			return bh;
 		}
 		de++;
@@ -185,43 +563,43 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 #endif
 	if (!namelen)
 		return NULL;
-	if (!(block = dir->i_zone[0])) //确定目标目录文件第一个文件块在设备上的逻辑块号
-		return NULL;
-	if (!(bh = bread(dir->i_dev,block))) //将目录文件的内容载入一个数据块
+	if (!dir->i_zone[0]) //目标目录文件必须已有第一个文件块
 		return NULL;
-	i = 0;
-	de = (struct dir_entry *) bh->b_data;
+	i = dir->i_dfree; //从第一个可能空闲的目录项开始找
+	bh = NULL;
+	de = NULL;
 
     //在目录文件中搜索空闲目录项
     //如果整个数据块中都没有空闲项，就载入下一个数据块继续搜索
     //全部载入后仍然没有，就在设备上新建数据块，用于加载新目录项
 	while (1) {
-		if ((char *)de >= BLOCK_SIZE+bh->b_data) {
+		if (!bh || (char *)de >= BLOCK_SIZE+bh->b_data) {
 			brelse(bh);
 			bh = NULL;
 			block = create_block(dir,i/DIR_ENTRIES_PER_BLOCK);
 			if (!block)
 				return NULL;
 			if (!(bh = bread(dir->i_dev,block))) {
-				i += DIR_ENTRIES_PER_BLOCK;
+				i = (i/DIR_ENTRIES_PER_BLOCK+1)*DIR_ENTRIES_PER_BLOCK;
 				continue;
 			}
-			de = (struct dir_entry *) bh->b_data;
+			de = i%DIR_ENTRIES_PER_BLOCK + (struct dir_entry *) bh->b_data;
 		}
         //如果在数据块的末端找到空闲项，就在空闲位置加载目录项
 		if (i*sizeof(struct dir_entry) >= dir->i_size) {
 			de->inode=0;
 			dir->i_size = (i+1)*sizeof(struct dir_entry);
-			dir->i_dirt = 1;
+			mark_inode_dirty(dir);
 			dir->i_ctime = CURRENT_TIME;
 		}
 
         //在数据块的中间某位置找到空闲项，就在该位置加载目录项
 		if (!de->inode) {
 			dir->i_mtime = CURRENT_TIME;
-			for (i=0; i < NAME_LEN ; i++)
-				de->name[i]=(i<namelen)?get_fs_byte(name+i):0;
-			bh->b_dirt = 1;
+			dir->i_dfree = i+1;
+			for (block=0; block < NAME_LEN ; block++)
+				de->name[block]=(block<namelen)?get_fs_byte(name+block):0;
+			dh_update(dir,de->name,i,1);
 			*res_dir = de;
 			return bh;
 		}
@@ -232,6 +610,20 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 	return NULL;
 }
 
+/*
+ * clear entry 'nr' (found by find_entry) and keep the index and the
+ * free slot hint of the directory right.
+ */
+static void del_entry(struct m_inode * dir, struct buffer_head * bh,
+	struct dir_entry * de, int nr)
+{
+	dh_update(dir,de->name,nr,0);
+	de->inode = 0;
+	journal_dirty(bh);
+	if (nr < dir->i_dfree)
+		dir->i_dfree = nr;
+}
+
 /*
  *	get_dir()
  *
@@ -281,7 +673,7 @@ static struct m_inode * get_dir(const char * pathname)
 			return inode;
 
         //通过目录文件的i节点和目录项信息，获取目录项
-		if (!(bh = find_entry(&inode,thisname,namelen,&de))) {
+		if (!(bh = find_entry(&inode,thisname,namelen,&de,NULL))) {
             //de会指向dev目录项
 			iput(inode);
 			return NULL;
@@ -343,7 +735,7 @@ struct m_inode * namei(const char * pathname)
 		return NULL;
 	if (!namelen)			/* special case: '/usr/' etc */
 		return dir;
-	bh = find_entry(&dir,basename,namelen,&de);
+	bh = find_entry(&dir,basename,namelen,&de,NULL);
 	if (!bh) {
 		iput(dir);
 		return NULL;
@@ -353,10 +745,8 @@ struct m_inode * namei(const char * pathname)
 	brelse(bh);
 	iput(dir);
 	dir=iget(dev,inr);
-	if (dir) {
-		dir->i_atime=CURRENT_TIME;
-		dir->i_dirt=1;
-	}
+	if (dir && update_atime(dir))
+		mark_inode_dirty(dir);		/* namei() always wrote it */
 	return dir;
 }
 
@@ -371,7 +761,7 @@ int open_namei(const char * pathname, int flag, int mode,
 	struct m_inode ** res_inode)
 {
 	const char * basename; //basename记录目录项名字前面'/'的地址
-	int inr,dev,namelen; //namelen记录名字的长度
+	int inr,dev,namelen,error; //namelen记录名字的长度
 	struct m_inode * dir, *inode;
 	struct buffer_head * bh;
 	struct dir_entry * de; //de用来指向目录项内容
@@ -391,7 +781,7 @@ int open_namei(const char * pathname, int flag, int mode,
 		return -EISDIR;
 	}
     //通过枝梢i节点，找到目标文件的目录项
-	bh = find_entry(&dir,basename,namelen,&de);
+	bh = find_entry(&dir,basename,namelen,&de,NULL);
 
     //tty0目录项找到了，缓冲块不可能为空，if中此时不会执行
 	if (!bh) {
@@ -403,14 +793,14 @@ int open_namei(const char * pathname, int flag, int mode,
 			iput(dir);
 			return -EACCES;
 		}
-		inode = new_inode(dir->i_dev);
+		inode = new_inode(dir->i_dev,&error);
 		if (!inode) {
 			iput(dir);
-			return -ENOSPC;
+			return -error;
 		}
 		inode->i_uid = current->euid;
 		inode->i_mode = mode;
-		inode->i_dirt = 1;
+		mark_inode_dirty(inode);
 		bh = add_entry(dir,basename,namelen,&de);
 		if (!bh) {
 			inode->i_nlinks--;
@@ -419,7 +809,7 @@ int open_namei(const char * pathname, int flag, int mode,
 			return -ENOSPC;
 		}
 		de->inode = inode->i_num;
-		bh->b_dirt = 1;
+		journal_dirty(bh);
 		brelse(bh);
 		iput(dir);
 		*res_inode = inode;
@@ -435,14 +825,14 @@ int open_namei(const char * pathname, int flag, int mode,
 
     // tty0这个文件的i节点
 	if (!(inode=iget(dev,inr)))
-		return -EACCES;
+		return -ENFILE;
 
     if ((S_ISDIR(inode->i_mode) && (flag & O_ACCMODE)) ||
 	    !permission(inode,ACC_MODE(flag))) {
 		iput(inode);
 		return -EPERM;
 	}
-	inode->i_atime = CURRENT_TIME;
+	update_atime(inode);
 	if (flag & O_TRUNC)
 		truncate(inode);
 	*res_inode = inode; //将此i节点传递给sys_open
@@ -452,7 +842,7 @@ int open_namei(const char * pathname, int flag, int mode,
 int sys_mknod(const char * filename, int mode, int dev)
 {
 	const char * basename;
-	int namelen;
+	int namelen,error;
 	struct m_inode * dir, * inode;
 	struct buffer_head * bh;
 	struct dir_entry * de;
@@ -469,22 +859,22 @@ int sys_mknod(const char * filename, int mode, int dev)
 		iput(dir);
 		return -EPERM;
 	}
-	bh = find_entry(&dir,basename,namelen,&de);
+	bh = find_entry(&dir,basename,namelen,&de,NULL);
 	if (bh) {
 		brelse(bh);
 		iput(dir);
 		return -EEXIST;
 	}
-	inode = new_inode(dir->i_dev);
+	inode = new_inode(dir->i_dev,&error);
 	if (!inode) {
 		iput(dir);
-		return -ENOSPC;
+		return -error;
 	}
 	inode->i_mode = mode;
 	if (S_ISBLK(mode) || S_ISCHR(mode))
 		inode->i_zone[0] = dev;
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
-	inode->i_dirt = 1;
+	mark_inode_dirty(inode);
 	bh = add_entry(dir,basename,namelen,&de);
 	if (!bh) {
 		iput(dir);
@@ -493,7 +883,7 @@ int sys_mknod(const char * filename, int mode, int dev)
 		return -ENOSPC;
 	}
 	de->inode = inode->i_num;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	iput(dir);
 	iput(inode);
 	brelse(bh);
@@ -503,10 +893,11 @@ int sys_mknod(const char * filename, int mode, int dev)
 int sys_mkdir(const char * pathname, int mode)
 {
 	const char * basename;
-	int namelen;
+	int namelen,error;
 	struct m_inode * dir, * inode;
 	struct buffer_head * bh, *dir_block;
 	struct dir_entry * de;
+	int block;
 
 	if (!suser())
 		return -EPERM;
@@ -520,30 +911,30 @@ int sys_mkdir(const char * pathname, int mode)
 		iput(dir);
 		return -EPERM;
 	}
-	bh = find_entry(&dir,basename,namelen,&de);
+	bh = find_entry(&dir,basename,namelen,&de,NULL);
 	if (bh) {
 		brelse(bh);
 		iput(dir);
 		return -EEXIST;
 	}
-	inode = new_inode(dir->i_dev);
+	inode = new_inode(dir->i_dev,&error);
 	if (!inode) {
 		iput(dir);
-		return -ENOSPC;
+		return -error;
 	}
 	inode->i_size = 32;
-	inode->i_dirt = 1;
+	inode->i_mode = I_DIRECTORY | (mode & 0777 & ~current->umask);
+	mark_inode_dirty(inode);
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
-	if (!(inode->i_zone[0]=new_block(inode->i_dev))) {
+    //第一个块由create_block分配（tmpfs上是内存页），出错时由iput里的truncate释放
+	if (!(block=create_block(inode,0))) {
 		iput(dir);
 		inode->i_nlinks--;
 		iput(inode);
 		return -ENOSPC;
 	}
-	inode->i_dirt = 1;
-	if (!(dir_block=bread(inode->i_dev,inode->i_zone[0]))) {
+	if (!(dir_block=bread(inode->i_dev,block))) {
 		iput(dir);
-		free_block(inode->i_dev,inode->i_zone[0]);
 		inode->i_nlinks--;
 		iput(inode);
 		return -ERROR;
@@ -555,22 +946,20 @@ int sys_mkdir(const char * pathname, int mode)
 	de->inode = dir->i_num;
 	strcpy(de->name,"..");
 	inode->i_nlinks = 2;
-	dir_block->b_dirt = 1;
+	journal_dirty(dir_block);
 	brelse(dir_block);
-	inode->i_mode = I_DIRECTORY | (mode & 0777 & ~current->umask);
-	inode->i_dirt = 1;
+	mark_inode_dirty(inode);
 	bh = add_entry(dir,basename,namelen,&de);
 	if (!bh) {
 		iput(dir);
-		free_block(inode->i_dev,inode->i_zone[0]);
 		inode->i_nlinks=0;
 		iput(inode);
 		return -ENOSPC;
 	}
 	de->inode = inode->i_num;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	dir->i_nlinks++;
-	dir->i_dirt = 1;
+	mark_inode_dirty(dir);
 	iput(dir);
 	iput(inode);
 	brelse(bh);
@@ -589,7 +978,7 @@ static int empty_dir(struct m_inode * inode)
 
 	len = inode->i_size / sizeof (struct dir_entry);
 	if (len<2 || !inode->i_zone[0] ||
-	    !(bh=bread(inode->i_dev,inode->i_zone[0]))) {
+	    !(bh=bread(inode->i_dev,bmap(inode,0)))) {
 	    	printk("warning - bad directory on dev %04x\n",inode->i_dev);
 		return 0;
 	}
@@ -627,7 +1016,7 @@ static int empty_dir(struct m_inode * inode)
 int sys_rmdir(const char * name)
 {
 	const char * basename;
-	int namelen;
+	int namelen,nr;
 	struct m_inode * dir, * inode;
 	struct buffer_head * bh;
 	struct dir_entry * de;
@@ -644,7 +1033,7 @@ int sys_rmdir(const char * name)
 		iput(dir);
 		return -EPERM;
 	}
-	bh = find_entry(&dir,basename,namelen,&de);
+	bh = find_entry(&dir,basename,namelen,&de,&nr);
 	if (!bh) {
 		iput(dir);
 		return -ENOENT;
@@ -652,7 +1041,7 @@ int sys_rmdir(const char * name)
 	if (!(inode = iget(dir->i_dev, de->inode))) {
 		iput(dir);
 		brelse(bh);
-		return -EPERM;
+		return -ENFILE;
 	}
 	if ((dir->i_mode & S_ISVTX) && current->euid &&
 	    inode->i_uid != current->euid) {
@@ -687,14 +1076,14 @@ int sys_rmdir(const char * name)
 	}
 	if (inode->i_nlinks != 2)
 		printk("empty directory has nlink!=2 (%d)",inode->i_nlinks);
-	de->inode = 0;
-	bh->b_dirt = 1;
+	del_entry(dir,bh,de,nr);
 	brelse(bh);
+	forget_dir_index(inode->i_dev,inode->i_num);
 	inode->i_nlinks=0;
-	inode->i_dirt=1;
+	mark_inode_dirty(inode);
 	dir->i_nlinks--;
 	dir->i_ctime = dir->i_mtime = CURRENT_TIME;
-	dir->i_dirt=1;
+	mark_inode_dirty(dir);
 	iput(dir);
 	iput(inode);
 	return 0;
@@ -703,7 +1092,7 @@ int sys_rmdir(const char * name)
 int sys_unlink(const char * name)
 {
 	const char * basename;
-	int namelen;
+	int namelen,nr;
 	struct m_inode * dir, * inode;
 	struct buffer_head * bh;
 	struct dir_entry * de;
@@ -718,7 +1107,7 @@ int sys_unlink(const char * name)
 		iput(dir);
 		return -EPERM;
 	}
-	bh = find_entry(&dir,basename,namelen,&de);
+	bh = find_entry(&dir,basename,namelen,&de,&nr);
 	if (!bh) {
 		iput(dir);
 		return -ENOENT;
@@ -726,7 +1115,7 @@ int sys_unlink(const char * name)
 	if (!(inode = iget(dir->i_dev, de->inode))) {
 		iput(dir);
 		brelse(bh);
-		return -ENOENT;
+		return -ENFILE;
 	}
 	if ((dir->i_mode & S_ISVTX) && !suser() &&
 	    current->euid != inode->i_uid &&
@@ -747,11 +1136,10 @@ int sys_unlink(const char * name)
 			inode->i_dev,inode->i_num,inode->i_nlinks);
 		inode->i_nlinks=1;
 	}
-	de->inode = 0;
-	bh->b_dirt = 1;
+	del_entry(dir,bh,de,nr);
 	brelse(bh);
 	inode->i_nlinks--;
-	inode->i_dirt = 1;
+	mark_inode_dirty(inode);
 	inode->i_ctime = CURRENT_TIME;
 	iput(inode);
 	iput(dir);
@@ -793,7 +1181,7 @@ int sys_link(const char * oldname, const char * newname)
 		iput(oldinode);
 		return -EACCES;
 	}
-	bh = find_entry(&dir,basename,namelen,&de);
+	bh = find_entry(&dir,basename,namelen,&de,NULL);
 	if (bh) {
 		brelse(bh);
 		iput(dir);
@@ -807,12 +1195,12 @@ int sys_link(const char * oldname, const char * newname)
 		return -ENOSPC;
 	}
 	de->inode = oldinode->i_num;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	brelse(bh);
 	iput(dir);
 	oldinode->i_nlinks++;
 	oldinode->i_ctime = CURRENT_TIME;
-	oldinode->i_dirt = 1;
+	mark_inode_dirty(oldinode);
 	iput(oldinode);
 	return 0;
 }
@@ -35,7 +35,7 @@ int sys_utime(char * filename, struct utimbuf * times)
 		actime = modtime = CURRENT_TIME;
 	inode->i_atime = actime;
 	inode->i_mtime = modtime;
-	inode->i_dirt = 1;
+	mark_inode_dirty(inode);
 	iput(inode);
 	return 0;
 }
@@ -113,7 +113,7 @@ int sys_chmod(const char * filename,int mode)
 		return -EACCES;
 	}
 	inode->i_mode = (mode & 07777) | (inode->i_mode & ~07777);
-	inode->i_dirt = 1;
+	mark_inode_dirty(inode);
 	iput(inode);
 	return 0;
 }
@@ -130,7 +130,7 @@ int sys_chown(const char * filename,int uid,int gid)
 	}
 	inode->i_uid=uid;
 	inode->i_gid=gid;
-	inode->i_dirt=1;
+	mark_inode_dirty(inode);
 	iput(inode);
 	return 0;
 }
@@ -142,33 +142,20 @@ int sys_open(const char * filename,int flag,int mode)
 	int i,fd;
 
 	mode &= 0777 & ~current->umask;
-    for(fd=0 ; fd<NR_OPEN ; fd++)
-		if (!current->filp[fd]) //遍历进程1的filp，直到获取一个空闲项，fd就是这个空闲项的索引
-			break;
-    //如果此条件成立，说明 filp[20] 中没有空闲项了，直接返回
-	if (fd>=NR_OPEN)
-		return -EINVAL;
-	current->close_on_exec &= ~(1<<fd);
-
-    //获取file_table[64]首地址
-	f=0+file_table;
-
-    //遍历file_table[64],直到获取到一个空闲项，f就是这个空闲项的指针
-	for (i=0 ; i<NR_FILE ; i++,f++)
-		if (!f->f_count) break;
-
-    //如果此条件成立，说明file_table[20]中没有空闲项了，直接返回
-	if (i>=NR_FILE)
-		return -EINVAL;
-
-    //将进程1的filp[20]与file_table[64]挂接，并增加引用计数
-	(current->filp[fd]=f)->f_count++;
+	if ((fd = get_unused_fd(0)) < 0)
+		return fd;
+	if (!(f = get_empty_filp())) {
+		put_unused_fd(fd);
+		return -ENFILE;
+	}
+	current->filp[fd] = f;
 
     //获取文件inode，即标准输入设备文件的inode，此时的filename就是路径/dev/tty0的指针
     //open("/dev/tty0",O_RDWR,0);
 	if ((i=open_namei(filename,flag,mode,&inode))<0) {
 		current->filp[fd]=NULL;
-		f->f_count=0;
+		put_unused_fd(fd);
+		put_filp(f);
 		return i;
 	}
 /* ttys are somewhat special (ttyxx major==4, tty major==5) */
@@ -186,7 +173,8 @@ int sys_open(const char * filename,int flag,int mode)
 			if (current->tty<0) {
 				iput(inode);
 				current->filp[fd]=NULL;
-				f->f_count=0;
+				put_unused_fd(fd);
+				put_filp(f);
 				return -EPERM;
 			}
 	}
@@ -198,6 +186,7 @@ int sys_open(const char * filename,int flag,int mode)
 	f->f_count = 1; //将文件引用计数加1
 	f->f_inode = inode; //文件与i节点建立关系
 	f->f_pos = 0; //将文件读写指针设置为0
+	f->f_cnr = 0;
 	return (fd);
 }
 
@@ -208,21 +197,22 @@ int sys_creat(const char * pathname, int mode)
 
 // 由于进程2继承了进程1的管理信息，因此其filp[20]中文件指针存储情况与进程1是一致的。
 // close（0）就是要将filp[20]第一项清空（就是关闭标准输入设备文件tty0），
-// 并递减file_table[64]中f_count的引用计数。
+// 并递减文件结构中f_count的引用计数。
 int sys_close(unsigned int fd)
 {	
 	struct file * filp;
 
-	if (fd >= NR_OPEN)
+	if (fd >= current->max_fds)
 		return -EINVAL;
-	current->close_on_exec &= ~(1<<fd);
 	if (!(filp = current->filp[fd])) //获取进程2标准输入设备文件的指针
 		return -EINVAL;
 	current->filp[fd] = NULL; //进程2与该设备文件解除关系
+	put_unused_fd(fd);
 	if (filp->f_count == 0)
 		panic("Close: file count is 0");
 	if (--filp->f_count) //该设备文件引用计数递减
 		return (0);
 	iput(filp->f_inode);
+	put_filp(filp);
 	return (0);
 }
@@ -5,6 +5,7 @@
  */
 
 #include <signal.h>
+#include <errno.h>
 
 #include <linux/sched.h>
 #include <linux/mm.h>	/* for get_free_page */
@@ -31,8 +32,8 @@ int read_pipe(struct m_inode * inode, char * buf, int count)
 		size = PIPE_TAIL(*inode);
 		PIPE_TAIL(*inode) += chars;
 		PIPE_TAIL(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			put_fs_byte(((char *)inode->i_size)[size++],buf++);
+		memcpy_tofs(buf,size + (char *)inode->i_size,chars);
+		buf += chars;
 	}
 	wake_up(&inode->i_wait);
 	return read;
@@ -61,8 +62,8 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
 		size = PIPE_HEAD(*inode);
 		PIPE_HEAD(*inode) += chars;
 		PIPE_HEAD(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			((char *)inode->i_size)[size++]=get_fs_byte(buf++);
+		memcpy_fromfs(size + (char *)inode->i_size,buf,chars);
+		buf += chars;
 	}
 	wake_up(&inode->i_wait);
 	return written;
@@ -73,34 +74,29 @@ int sys_pipe(unsigned long * fildes)
 	struct m_inode * inode;
 	struct file * f[2];
 	int fd[2];
-	int i,j;
 
-	j=0;
-	for(i=0;j<2 && i<NR_FILE;i++)
-		if (!file_table[i].f_count)
-			(f[j++]=i+file_table)->f_count++;
-	if (j==1)
-		f[0]->f_count=0;
-	if (j<2)
-		return -1;
-	j=0;
-	for(i=0;j<2 && i<NR_OPEN;i++)
-		if (!current->filp[i]) {
-			current->filp[ fd[j]=i ] = f[j];
-			j++;
-		}
-	if (j==1)
-		current->filp[fd[0]]=NULL;
-	if (j<2) {
-		f[0]->f_count=f[1]->f_count=0;
-		return -1;
+	if (!(f[0] = get_empty_filp()))
+		return -ENFILE;
+	if (!(f[1] = get_empty_filp())) {
+		put_filp(f[0]);
+		return -ENFILE;
+	}
+	if ((fd[0] = get_unused_fd(0)) < 0 || (fd[1] = get_unused_fd(0)) < 0) {
+		if (fd[0] >= 0)
+			put_unused_fd(fd[0]);
+		put_filp(f[0]);
+		put_filp(f[1]);
+		return -EMFILE;
 	}
 	if (!(inode=get_pipe_inode())) {
-		current->filp[fd[0]] =
-			current->filp[fd[1]] = NULL;
-		f[0]->f_count = f[1]->f_count = 0;
-		return -1;
+		put_unused_fd(fd[0]);
+		put_unused_fd(fd[1]);
+		put_filp(f[0]);
+		put_filp(f[1]);
+		return -ENFILE;
 	}
+	current->filp[fd[0]] = f[0];
+	current->filp[fd[1]] = f[1];
 	f[0]->f_inode = f[1]->f_inode = inode;
 	f[0]->f_pos = f[1]->f_pos = 0;
 	f[0]->f_mode = 1;		/* read */
@@ -28,7 +28,7 @@ int sys_lseek(unsigned int fd,off_t offset, int origin)
 	struct file * file;
 	int tmp;
 
-	if (fd >= NR_OPEN || !(file=current->filp[fd]) || !(file->f_inode)
+	if (fd >= current->max_fds || !(file=current->filp[fd]) || !(file->f_inode)
 	   || !IS_SEEKABLE(MAJOR(file->f_inode->i_dev)))
 		return -EBADF;
 	if (file->f_inode->i_pipe)
@@ -58,7 +58,7 @@ int sys_read(unsigned int fd,char * buf,int count)
 	struct file * file;
 	struct m_inode * inode;
 
-	if (fd>=NR_OPEN || count<0 || !(file=current->filp[fd]))
+	if (fd>=current->max_fds || count<0 || !(file=current->filp[fd]))
 		return -EINVAL;
 	if (!count)
 		return 0;
@@ -83,6 +83,8 @@ int sys_read(unsigned int fd,char * buf,int count)
 			count = inode->i_size - file->f_pos;
 		if (count<=0)
 			return 0;
+		if (IS_TMPFS(inode->i_dev))
+			return tmpfs_read(inode,file,buf,count);
 		return file_read(inode,file,buf,count);
 	}
 
@@ -106,7 +108,7 @@ int sys_write(unsigned int fd,char * buf,int count)
 	struct m_inode * inode;
 
     //fd,count是否在合理范围内及文件是否已经打开
-	if (fd>=NR_OPEN || count <0 || !(file=current->filp[fd]))
+	if (fd>=current->max_fds || count <0 || !(file=current->filp[fd]))
 		return -EINVAL;
 
     //如何写入字节数为0，直接返回
@@ -121,9 +123,91 @@ int sys_write(unsigned int fd,char * buf,int count)
 		return block_write(inode->i_zone[0],&file->f_pos,buf,count);
 
     //待写入文件是普通文件
-	if (S_ISREG(inode->i_mode))
+	if (S_ISREG(inode->i_mode)) {
+		if (IS_TMPFS(inode->i_dev))
+			return tmpfs_write(inode,file,buf,count);
 		return file_write(inode,file,buf,count);
+	}
 
 	printk("(Write)inode->i_mode=%06o\n\r",inode->i_mode);
 	return -EINVAL;
 }
+
+/*
+ * sendfile() copies up to 'count' bytes of the regular file in_fd to
+ * out_fd without a trip through user space: each block goes from the
+ * buffer cache straight into sys_write(), with %fs pointing at kernel
+ * data meanwhile. If 'offset' is given, the copy starts there and it is
+ * updated; otherwise the file position of in_fd is used and moved.
+ *
+ * A system call only gets three arguments in registers, so this one
+ * takes a pointer to its four: out_fd, in_fd, offset and count, as
+ * longs (like mmap()).
+ */
+int sys_sendfile(unsigned long * buffer)
+{
+	static char zero_block[BLOCK_SIZE];
+	struct file * file;
+	struct m_inode * inode;
+	struct buffer_head * bh;
+	unsigned long old_fs;
+	unsigned int out_fd,in_fd;
+	off_t * offset;
+	off_t pos;
+	int count,nr,chars,written=0;
+
+	out_fd = get_fs_long(buffer);
+	in_fd = get_fs_long(buffer+1);
+	offset = (off_t *) get_fs_long(buffer+2);
+	count = get_fs_long(buffer+3);
+	if (in_fd>=current->max_fds || out_fd>=current->max_fds ||
+	    !(file=current->filp[in_fd]) || !current->filp[out_fd])
+		return -EBADF;
+	if (count<0)
+		return -EINVAL;
+	inode = file->f_inode;
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+	if (offset) {
+		verify_area(offset,sizeof(off_t));
+		if ((pos = get_fs_long((unsigned long *) offset)) < 0)
+			return -EINVAL;
+	} else
+		pos = file->f_pos;
+	if (pos >= inode->i_size)
+		count = 0;
+	else if (count > inode->i_size - pos)
+		count = inode->i_size - pos;
+	while (count>0) {
+		if ((nr = bmap(inode,pos/BLOCK_SIZE))) {
+			if (!(bh=bread(inode->i_dev,nr)))
+				break;
+		} else
+			bh = NULL;
+		nr = pos % BLOCK_SIZE;
+		chars = BLOCK_SIZE-nr;
+		if (chars > count)
+			chars = count;
+		old_fs = get_fs();
+		set_fs(get_ds());
+		nr = sys_write(out_fd,nr + (bh ? bh->b_data : zero_block),chars);
+		set_fs(old_fs);
+		brelse(bh);
+		if (nr <= 0) {
+			if (!written)
+				written = nr;
+			break;
+		}
+		pos += nr;
+		written += nr;
+		count -= nr;
+		if (nr < chars)
+			break;
+	}
+	if (offset)
+		put_fs_long(pos,(unsigned long *) offset);
+	else
+		file->f_pos = pos;
+	update_atime(inode);
+	return written;
+}
@@ -0,0 +1,76 @@
+/*
+ *  linux/fs/readdir.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+
+#define NAME_OFFSET ((int) ((struct dirent *) 0)->d_name)
+#define RECLEN(namelen) ((NAME_OFFSET+(namelen)+1+3) & ~3)
+
+/*
+ * getdents() copies as many live entries as fit in 'count' bytes, as
+ * struct dirent records, instead of making the user read() the raw
+ * dir_entry slots. Returns the bytes filled in, 0 at the end of the
+ * directory, and -EINVAL if not even the next record fits.
+ */
+int sys_getdents(unsigned int fd, struct dirent * dirp, unsigned int count)
+{
+	struct file * file;
+	struct m_inode * inode;
+	struct buffer_head * bh = NULL;
+	struct dir_entry * de;
+	char * buf = (char *) dirp;
+	off_t pos;
+	int block = -1;
+	int i,namelen,reclen,written = 0;
+
+	if (fd >= current->max_fds || !(file=current->filp[fd]))
+		return -EBADF;
+	inode = file->f_inode;
+	if (!S_ISDIR(inode->i_mode))
+		return -ENOTDIR;
+	verify_area(dirp,count);
+	pos = file->f_pos & ~(sizeof (struct dir_entry) - 1);
+	for ( ; pos < inode->i_size ; pos += sizeof (struct dir_entry)) {
+		if (pos/BLOCK_SIZE != block) {
+			brelse(bh);
+			bh = NULL;
+			block = pos/BLOCK_SIZE;
+			if (!(i = bmap(inode,block)) || !(bh = bread(inode->i_dev,i))) {
+				pos = (block+1)*BLOCK_SIZE - sizeof (struct dir_entry);
+				continue;
+			}
+		}
+		de = (struct dir_entry *) (bh->b_data + pos%BLOCK_SIZE);
+		if (!de->inode)
+			continue;
+		for (namelen=0 ; namelen<NAME_LEN && de->name[namelen] ; namelen++)
+			/* nothing */ ;
+		reclen = RECLEN(namelen);
+		if (written + reclen > count) {
+			if (!written)
+				written = -EINVAL;
+			break;
+		}
+		put_fs_long(de->inode,(unsigned long *) buf);
+		put_fs_long(pos + sizeof (struct dir_entry),(unsigned long *) (buf+4));
+		put_fs_word(reclen,(short *) (buf+8));
+		memcpy_tofs(buf+NAME_OFFSET,de->name,namelen);
+		for (i=NAME_OFFSET+namelen ; i<reclen ; i++)
+			put_fs_byte(0,buf+i);
+		buf += reclen;
+		written += reclen;
+	}
+	brelse(bh);
+	file->f_pos = pos;
+	update_atime(inode);
+	return written;
+}
@@ -49,7 +49,7 @@ int sys_fstat(unsigned int fd, struct stat * statbuf)
 	struct file * f;
 	struct m_inode * inode;
 
-	if (fd >= NR_OPEN || !(f=current->filp[fd]) || !(inode=f->f_inode))
+	if (fd >= current->max_fds || !(f=current->filp[fd]) || !(inode=f->f_inode))
 		return -EBADF;
 	cp_stat(inode,statbuf);
 	return 0;
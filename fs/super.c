@@ -88,6 +88,8 @@ void put_super(int dev)
 		return;
 	}
 	lock_super(sb);
+	if (IS_TMPFS(dev))
+		tmpfs_put_super(sb);
 	sb->s_dev = 0;
 	for(i=0;i<I_MAP_SLOTS;i++)
 		brelse(sb->s_imap[i]);
@@ -101,6 +103,7 @@ static struct super_block * read_super(int dev)
 {
 	struct super_block * s;
 	struct buffer_head * bh;
+	struct d_super_block * d;
 	int i,block;
 
 	if (!dev)
@@ -119,10 +122,19 @@ static struct super_block * read_super(int dev)
 	s->s_dev = dev;
 	s->s_isup = NULL;
 	s->s_imount = NULL;
+	s->s_journal = NULL;
 	s->s_time = 0;
 	s->s_rd_only = 0;
 	s->s_dirt = 0;
+	s->s_flags = 0;
 	lock_super(s); //锁定超级块
+    //tmpfs没有盘上的超级块，在内存中建一个空的文件系统
+	if (IS_TMPFS(dev)) {
+		if (!tmpfs_read_super(s))
+			s->s_dev = 0;
+		free_super(s);
+		return s->s_dev ? s : NULL;
+	}
     //调用bread（）函数，把超级块从虚拟盘上读进缓冲区，并从缓冲区复制到super_block[8]的第一项。
     //给硬盘发送操作命令，do_hd_request()
     //当前给虚拟盘发送命令，do_rd_request()
@@ -133,11 +145,27 @@ static struct super_block * read_super(int dev)
 		free_super(s);
 		return NULL;
 	}
-	*((struct d_super_block *) s) =      //将缓冲区中的超级块复制到
-		*((struct d_super_block *) bh->b_data); //super_block[8]第一项
+    //将缓冲区中的超级块逐项复制到super_block[8]第一项，v1和v2只有区块数不同
+	d = (struct d_super_block *) bh->b_data;
+	s->s_ninodes = d->s_ninodes;
+	s->s_imap_blocks = d->s_imap_blocks;
+	s->s_zmap_blocks = d->s_zmap_blocks;
+	s->s_firstdatazone = d->s_firstdatazone;
+	s->s_log_zone_size = d->s_log_zone_size;
+	s->s_max_size = d->s_max_size;
+	s->s_magic = d->s_magic;
+	if (s->s_magic == SUPER_MAGIC_V2) {
+		s->s_nzones = d->s_zones;
+		s->s_version = 2;
+	} else {
+		s->s_nzones = d->s_nzones;
+		s->s_version = 1;
+	}
 	brelse(bh); //释放这个缓冲块
     //判断超级块的魔术数字是否正确，正确释放超级块
-	if (s->s_magic != SUPER_MAGIC) {
+	if ((s->s_magic != SUPER_MAGIC && s->s_magic != SUPER_MAGIC_V2) ||
+	    s->s_imap_blocks > I_MAP_SLOTS || s->s_zmap_blocks > Z_MAP_SLOTS ||
+	    s->s_log_zone_size > 3) {	/* zones of at most 8 blocks */
 		s->s_dev = 0;
 		free_super(s);
 		return NULL;
@@ -186,6 +214,7 @@ static struct super_block * read_super(int dev)
 	s->s_imap[0]->b_data[0] |= 1;
 	s->s_zmap[0]->b_data[0] |= 1; //与0号i节点混淆?
 	free_super(s); //超级块设置完毕，解除对超级块项的保护
+	journal_mount(s); //有/.journal的话先重放日志
 	return s;
 }
 
@@ -209,9 +238,13 @@ int sys_umount(char * dev_name)
 		return -ENOENT;
 	if (!sb->s_imount->i_mount)
 		printk("Mounted inode has i_mount=0\n");
+	sync_truncates(dev);
 	for (inode=inode_table+0 ; inode<inode_table+NR_INODE ; inode++)
-		if (inode->i_dev==dev && inode->i_count)
+		if (inode->i_dev==dev && inode->i_count && inode!=sb->s_journal)
 				return -EBUSY;
+	sync_dev(dev);
+	forget_dir_index(dev,0);
+	journal_umount(sb);
 	sb->s_imount->i_mount=0;
 	iput(sb->s_imount);
 	sb->s_imount = NULL;
@@ -222,7 +255,7 @@ int sys_umount(char * dev_name)
 	return 0;
 }
 
-int sys_mount(char * dev_name, char * dir_name, int rw_flag)
+int sys_mount(char * dev_name, char * dir_name, int flags)
 {
 	struct m_inode * dev_i, * dir_i;
 	struct super_block * sb;
@@ -266,9 +299,10 @@ int sys_mount(char * dev_name, char * dir_name, int rw_flag)
 		iput(dir_i);
 		return -EPERM;
 	}
+	sb->s_flags = flags & (MS_NOATIME|MS_RELATIME);
 	sb->s_imount=dir_i; //将超级块中s_imount与根文件系统中dir_i挂接
 	dir_i->i_mount=1;   //给dir_i做标记，表明该i节点上已经挂接了文件系统
-	dir_i->i_dirt=1;	//给dir_i做标记，表明i节点上的信息已经被更改
+	mark_inode_dirty(dir_i);	//给dir_i做标记，表明i节点上的信息已经被更改
 
                         /* NOTE! we don't iput(dir_i) */
 	return 0;			/* we do that in umount */
@@ -280,13 +314,9 @@ void mount_root(void)
 	struct super_block * p;
 	struct m_inode * mi;
 
-	if (32 != sizeof (struct d_inode))
+	if (32 != sizeof (struct d_inode) || 64 != sizeof (struct d2_inode))
 		panic("bad i-node size");
 
-    //初始化file_table[64]
-	for(i=0;i<NR_FILE;i++)
-		file_table[i].f_count=0;
-
     //2代表软盘，根设备是虚拟盘为1
     if (MAJOR(ROOT_DEV) == 2) {
 		printk("Insert root floppy and press ENTER");
@@ -302,6 +332,7 @@ void mount_root(void)
     //从虚拟盘中读取设备的超级块，并复制到super_block[8]数组中
 	if (!(p=read_super(ROOT_DEV)))
 		panic("Unable to mount root");
+	p->s_flags = ROOT_MOUNT_FLAGS;
 
     //调用iget()函数，从虚拟盘上读取根节点inode。通过根inode可以到文件系统中任何指定的inode，即能找到任何指定的文件。
     //将inode指针返回并赋值给mi指针
@@ -0,0 +1,286 @@
+/*
+ *  linux/fs/tmpfs.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * tmpfs is a filesystem that lives only in pages from get_free_page().
+ * It is mounted from a block special file of major 8, the minor picks
+ * one of NR_TMPFS instances: mknod /dev/tmp b 8 0; mount /dev/tmp /tmp.
+ *
+ * It looks like a v2 minix fs to the rest of fs/, except that "block
+ * numbers" are the kernel addresses of the data >> 10. getblk() hands
+ * out uncached buffer heads pointing straight at such addresses, so
+ * namei.c, the inode code and the inode bitmap work unchanged, while
+ * file data is copied to and from the pages by tmpfs_read/write().
+ * Nothing on a tmpfs ever reaches ll_rw_block().
+ *
+ * The inode zones point to pages: 7 direct, then an indirect and a
+ * double indirect page of 1024 page addresses each.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+
+#include <linux/config.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/segment.h>
+#include <sys/stat.h>
+#include <const.h>
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+extern void invalidate_inodes(int dev);
+
+#define NR_TMPFS 4
+#define PTRS_BITS 10
+#define PTRS_PER_PAGE (1<<PTRS_BITS)	/* page addresses in a page */
+#define PAGE_BLOCKS (PAGE_SIZE/BLOCK_SIZE)
+#define IPAGE_INODES (PAGE_SIZE/sizeof(struct d2_inode))
+#define NR_IPAGES ((TMPFS_INODES+IPAGE_INODES-1)/IPAGE_INODES)
+
+#define ADDR_BLOCK(addr) ((addr) >> BLOCK_SIZE_BITS)
+
+static struct tmpfs {
+	unsigned long imap;			/* inode bitmap page */
+	unsigned long itable[NR_IPAGES];	/* inode table, from inode 1 */
+	int pages;				/* data pages in use */
+} tmpfs[NR_TMPFS];
+
+#define TMPFS(dev) (tmpfs+MINOR(dev))
+#define ITABLE(t,nr) (((nr)-1)%IPAGE_INODES + \
+	(struct d2_inode *) (t)->itable[((nr)-1)/IPAGE_INODES])
+
+static unsigned long get_page(struct tmpfs * t)
+{
+	unsigned long page;
+
+	if (t->pages >= TMPFS_PAGES || !(page = get_free_page()))
+		return 0;
+	t->pages++;
+	return page;
+}
+
+static void free_tree(struct tmpfs * t, unsigned long page, int depth)
+{
+	int i;
+
+	if (!page)
+		return;
+	if (depth)
+		for (i=0 ; i<PTRS_PER_PAGE ; i++)
+			free_tree(t,((unsigned long *) page)[i],depth-1);
+	free_page(page);
+	t->pages--;
+}
+
+static void free_zones(struct tmpfs * t, unsigned long * zone)
+{
+	int i;
+
+	for (i=0 ; i<9 ; i++) {
+		free_tree(t,zone[i],i<7 ? 0 : i-6);
+		zone[i] = 0;
+	}
+}
+
+int tmpfs_read_super(struct super_block * sb)
+{
+	struct tmpfs * t = TMPFS(sb->s_dev);
+	struct d2_inode * root;
+	struct dir_entry * de;
+	unsigned long page;
+	int i;
+
+	if (MINOR(sb->s_dev) >= NR_TMPFS)
+		return 0;
+	t->pages = 0;
+	t->imap = get_free_page();
+	for (i=0 ; i<NR_IPAGES ; i++)
+		if (!(t->itable[i] = get_free_page()))
+			break;
+	if (!t->imap || i<NR_IPAGES || !(page = get_page(t))) {
+		tmpfs_put_super(sb);
+		return 0;
+	}
+	sb->s_ninodes = TMPFS_INODES;
+	sb->s_nzones = TMPFS_PAGES;
+	sb->s_imap_blocks = 1;
+	sb->s_zmap_blocks = 0;
+	sb->s_firstdatazone = 0;
+	sb->s_log_zone_size = 0;
+	sb->s_max_size = TMPFS_PAGES*PAGE_SIZE;
+	sb->s_magic = 0;
+	sb->s_version = 2;
+	for (i=0 ; i<I_MAP_SLOTS ; i++)
+		sb->s_imap[i] = NULL;
+	for (i=0 ; i<Z_MAP_SLOTS ; i++)
+		sb->s_zmap[i] = NULL;
+	sb->s_imap[0] = getblk(sb->s_dev,ADDR_BLOCK(t->imap));
+	sb->s_imap[0]->b_data[0] |= 3;		/* inode 0 and the root */
+	root = ITABLE(t,ROOT_INO);
+	root->i_mode = I_DIRECTORY | S_ISVTX | 0777;
+	root->i_nlinks = 2;
+	root->i_uid = current->euid;
+	root->i_gid = current->egid;
+	root->i_size = 2*sizeof(struct dir_entry);
+	root->i_atime = root->i_mtime = root->i_ctime = CURRENT_TIME;
+	root->i_zone[0] = page;
+	de = (struct dir_entry *) page;
+	de[0].inode = de[1].inode = ROOT_INO;
+	de[0].name[0] = de[1].name[0] = de[1].name[1] = '.';
+	return 1;
+}
+
+/*
+ * Called from put_super() when the tmpfs is unmounted: everything in
+ * it goes away.
+ */
+void tmpfs_put_super(struct super_block * sb)
+{
+	struct tmpfs * t = TMPFS(sb->s_dev);
+	struct d2_inode * d;
+	int i;
+
+	invalidate_inodes(sb->s_dev);
+	for (i=1 ; i<=TMPFS_INODES ; i++) {
+		if (!t->imap || !t->itable[(i-1)/IPAGE_INODES])
+			break;
+		d = ITABLE(t,i);
+		if (((char *) t->imap)[i>>3] & (1<<(i&7)) &&
+		    (S_ISREG(d->i_mode) || S_ISDIR(d->i_mode)))
+			free_zones(t,d->i_zone);
+	}
+	if (t->pages)
+		printk("tmpfs: %d pages lost\n\r",t->pages);
+	for (i=0 ; i<NR_IPAGES ; i++)
+		if (t->itable[i]) {
+			free_page(t->itable[i]);
+			t->itable[i] = 0;
+		}
+	if (t->imap) {
+		free_page(t->imap);
+		t->imap = 0;
+	}
+}
+
+/* INODE_BLOCK() for a tmpfs: inodes are laid out as on a v2 fs */
+int tmpfs_inode_block(struct super_block * sb, int nr)
+{
+	if (nr < 1 || nr > TMPFS_INODES)
+		panic("tmpfs: bad inode number");
+	nr = (nr-1)/V2_INODES_PER_BLOCK;
+	return ADDR_BLOCK(TMPFS(sb->s_dev)->itable[nr/PAGE_BLOCKS]) +
+		nr%PAGE_BLOCKS;
+}
+
+/*
+ * Address of page 'n' of the file, allocating it (and the indirect
+ * pages on the way) if 'create' is set. 0 for a hole or no memory.
+ */
+static unsigned long page_map(struct m_inode * inode, unsigned long n,
+	int create)
+{
+	unsigned long * slot;
+	int depth;
+
+	if (n < 7) {
+		slot = inode->i_zone + n;
+		depth = 0;
+	} else if ((n -= 7) < PTRS_PER_PAGE) {
+		slot = inode->i_zone + 7;
+		depth = 1;
+	} else if ((n -= PTRS_PER_PAGE) < PTRS_PER_PAGE*PTRS_PER_PAGE) {
+		slot = inode->i_zone + 8;
+		depth = 2;
+	} else
+		return 0;
+	if (!*slot) {
+		if (!create || !(*slot = get_page(TMPFS(inode->i_dev))))
+			return 0;
+		inode->i_ctime = CURRENT_TIME;
+		mark_inode_dirty(inode);
+	}
+	while (depth--) {
+		slot = (unsigned long *) *slot +
+			((n >> (PTRS_BITS*depth)) & (PTRS_PER_PAGE-1));
+		if (!*slot && (!create ||
+		    !(*slot = get_page(TMPFS(inode->i_dev)))))
+			return 0;
+	}
+	return *slot;
+}
+
+int tmpfs_bmap(struct m_inode * inode, int block, int create)
+{
+	unsigned long page;
+
+	if (!(page = page_map(inode,block/PAGE_BLOCKS,create)))
+		return 0;
+	return ADDR_BLOCK(page) + block%PAGE_BLOCKS;
+}
+
+void tmpfs_truncate(struct m_inode * inode)
+{
+	free_zones(TMPFS(inode->i_dev),inode->i_zone);
+}
+
+int tmpfs_read(struct m_inode * inode, struct file * filp, char * buf, int count)
+{
+	unsigned long page;
+	int left,chars,nr;
+
+	if ((left=count)<=0)
+		return 0;
+	while (left) {
+		nr = filp->f_pos % PAGE_SIZE;
+		chars = MIN( PAGE_SIZE-nr , left );
+		if ((page = page_map(inode,filp->f_pos/PAGE_SIZE,0)))
+			memcpy_tofs(buf,nr + (char *) page,chars);
+		else
+			for (nr=0 ; nr<chars ; nr++)
+				put_fs_byte(0,buf+nr);
+		filp->f_pos += chars;
+		buf += chars;
+		left -= chars;
+	}
+	update_atime(inode);
+	return count;
+}
+
+int tmpfs_write(struct m_inode * inode, struct file * filp, char * buf, int count)
+{
+	unsigned long page;
+	off_t pos;
+	int c,i=0;
+
+	if (filp->f_flags & O_APPEND)
+		pos = inode->i_size;
+	else
+		pos = filp->f_pos;
+	while (i<count) {
+		if (!(page = page_map(inode,pos/PAGE_SIZE,1)))
+			break;
+		c = pos % PAGE_SIZE;
+		page += c;
+		c = PAGE_SIZE-c;
+		if (c > count-i) c = count-i;
+		memcpy_fromfs((char *) page,buf,c);
+		buf += c;
+		pos += c;
+		i += c;
+		if (pos > inode->i_size) {
+			inode->i_size = pos;
+			mark_inode_dirty(inode);
+		}
+	}
+	inode->i_mtime = CURRENT_TIME;
+	if (!(filp->f_flags & O_APPEND)) {
+		filp->f_pos = pos;
+		inode->i_ctime = CURRENT_TIME;
+	}
+	return (i?i:-ENOSPC);
+}
@@ -4,62 +4,185 @@
  *  (C) 1991  Linus Torvalds
  */
 
+#include <errno.h>
+
 #include <linux/sched.h>
+#include <linux/kernel.h>
 
 #include <sys/stat.h>
 
-static void free_ind(int dev,int block)
+/*
+ * truncate() frees the direct zones of a file itself, but only detaches
+ * the indirect trees: they go on trunc_queue, and the truncd task (which
+ * init starts) frees them later, so that removing a big file doesn't
+ * have to read all its indirect blocks first. If the queue is full or
+ * there is no truncd, they are freed on the spot. sync() and umount()
+ * drain the queue, and new_block() does so before giving up.
+ */
+#define NR_TRUNC 64
+#define NR_BATCH 64
+
+static struct trunc_req {
+	unsigned short dev;		/* 0: slot is free */
+	unsigned char depth;		/* 1: ind, 2: dind, 3: tind */
+	unsigned char v2;		/* v2 fs: 32-bit zone numbers */
+	unsigned char log;		/* s_log_zone_size */
+	int block;
+} trunc_queue[NR_TRUNC];
+
+static int truncd_running = 0;
+static int trunc_busy = 0;
+static struct task_struct * truncd_wait = NULL;
+static struct task_struct * trunc_done = NULL;
+
+/* blocks are collected here so that free_blocks() can sort them */
+struct batch {
+	int dev;
+	int v2;
+	int log;
+	int nr;
+	int block[NR_BATCH];
+};
+
+static void batch_add(struct batch * b, int block)
+{
+	if (b->nr == NR_BATCH) {
+		free_blocks(b->dev,b->block,b->nr);
+		b->nr = 0;
+	}
+	b->block[b->nr++] = block;
+}
+
+static void free_tree(struct batch * b, int block, int depth)
 {
 	struct buffer_head * bh;
-	unsigned short * p;
-	int i;
+	int i,nr;
 
 	if (!block)
 		return;
-	if ((bh=bread(dev,block))) {
-		p = (unsigned short *) bh->b_data;
-		for (i=0;i<512;i++,p++)
-			if (*p)
-				free_block(dev,*p);
+	if ((bh=bread(b->dev,block << b->log))) {
+		for (i=0 ; i < 1<<IND_BITS(b->v2) ; i++)
+			if ((nr = IND_ZONE(bh,i,b->v2))) {
+				if (depth > 1)
+					free_tree(b,nr,depth-1);
+				else
+					batch_add(b,nr);
+			}
 		brelse(bh);
 	}
-	free_block(dev,block);
+	batch_add(b,block);
 }
 
-static void free_dind(int dev,int block)
+static void queue_tree(struct batch * b, int block, int depth)
 {
-	struct buffer_head * bh;
-	unsigned short * p;
 	int i;
 
 	if (!block)
 		return;
-	if ((bh=bread(dev,block))) {
-		p = (unsigned short *) bh->b_data;
-		for (i=0;i<512;i++,p++)
-			if (*p)
-				free_ind(dev,*p);
-		brelse(bh);
+	if (truncd_running)
+		for (i=0 ; i<NR_TRUNC ; i++)
+			if (!trunc_queue[i].dev) {
+				trunc_queue[i].dev = b->dev;
+				trunc_queue[i].depth = depth;
+				trunc_queue[i].v2 = b->v2;
+				trunc_queue[i].log = b->log;
+				trunc_queue[i].block = block;
+				wake_up(&truncd_wait);
+				return;
+			}
+	free_tree(b,block,depth);
+}
+
+static void run_trunc(struct trunc_req * r)
+{
+	struct batch b;
+	int block = r->block;
+	int depth = r->depth;
+
+	b.dev = r->dev;
+	b.v2 = r->v2;
+	b.log = r->log;
+	b.nr = 0;
+	r->dev = 0;
+	trunc_busy++;
+	free_tree(&b,block,depth);
+	if (b.nr)
+		free_blocks(b.dev,b.block,b.nr);
+	if (!--trunc_busy)
+		wake_up(&trunc_done);
+}
+
+/*
+ * Free everything queued for 'dev' (all devices if 0) and wait until
+ * truncd is idle. Returns 0 if there was nothing to do.
+ */
+int sync_truncates(int dev)
+{
+	struct trunc_req * r;
+	int done = 0;
+
+repeat:
+	for (r=trunc_queue ; r<trunc_queue+NR_TRUNC ; r++)
+		if (r->dev && (!dev || r->dev == dev)) {
+			run_trunc(r);
+			done++;
+			goto repeat;
+		}
+	while (trunc_busy) {
+		sleep_on(&trunc_done);
+		done++;
+	}
+	return done;
+}
+
+int sys_truncd(void)
+{
+	struct trunc_req * r;
+
+	if (!suser())
+		return -EPERM;
+	if (truncd_running)
+		return -EBUSY;
+	truncd_running = 1;
+	for (;;) {
+		for (r=trunc_queue ; r<trunc_queue+NR_TRUNC ; r++)
+			if (r->dev)
+				break;
+		if (r < trunc_queue+NR_TRUNC)
+			run_trunc(r);
+		else
+			sleep_on(&truncd_wait);
 	}
-	free_block(dev,block);
 }
 
 void truncate(struct m_inode * inode)
 {
-	int i;
+	struct batch b;
+	int i,ind[3];
 
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
 		return;
+	if (IS_TMPFS(inode->i_dev))
+		tmpfs_truncate(inode);	/* leaves no zones for the code below */
+	b.dev = inode->i_dev;
+	b.v2 = inode->i_sb && inode->i_sb->s_version == 2;
+	b.log = inode->i_sb ? inode->i_sb->s_log_zone_size : 0;
+	b.nr = 0;
 	for (i=0;i<7;i++)
 		if (inode->i_zone[i]) {
-			free_block(inode->i_dev,inode->i_zone[i]);
+			batch_add(&b,inode->i_zone[i]);
 			inode->i_zone[i]=0;
 		}
-	free_ind(inode->i_dev,inode->i_zone[7]);
-	free_dind(inode->i_dev,inode->i_zone[8]);
-	inode->i_zone[7] = inode->i_zone[8] = 0;
+	for (i=0;i<3;i++) {
+		ind[i] = inode->i_zone[7+i];
+		inode->i_zone[7+i] = 0;
+	}
+	for (i=0;i<3;i++)
+		queue_tree(&b,ind[i],i+1);
+	if (b.nr)
+		free_blocks(b.dev,b.block,b.nr);
 	inode->i_size = 0;
-	inode->i_dirt = 1;
+	inode->i_tgen++;
+	mark_inode_dirty(inode);
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
 }
-
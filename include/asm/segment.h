@@ -40,6 +40,51 @@ static inline void put_fs_long(unsigned long val,unsigned long * addr)
 __asm__ ("movl %0,%%fs:%1"::"r" (val),"m" (*addr));
 }
 
+/*
+ * Bulk copies between the kernel and the user (%fs) segment. The odd
+ * byte and word go first, then the rest as longs. movs can only store
+ * through %es, so memcpy_tofs borrows it for the duration.
+ */
+static inline void memcpy_tofs(void * to, const void * from, unsigned long n)
+{
+	int d0,d1,d2;
+
+	__asm__ volatile ("cld\n\t"
+		"push %%es\n\t"
+		"push %%fs\n\t"
+		"pop %%es\n\t"
+		"testb $1,%%cl\n\t"
+		"je 1f\n\t"
+		"movsb\n"
+		"1:\ttestb $2,%%cl\n\t"
+		"je 2f\n\t"
+		"movsw\n"
+		"2:\tshrl $2,%%ecx\n\t"
+		"rep ; movsl\n\t"
+		"pop %%es"
+		:"=&c" (d0),"=&D" (d1),"=&S" (d2)
+		:"0" (n),"1" ((long) to),"2" ((long) from)
+		:"memory");
+}
+
+static inline void memcpy_fromfs(void * to, const void * from, unsigned long n)
+{
+	int d0,d1,d2;
+
+	__asm__ volatile ("cld\n\t"
+		"testb $1,%%cl\n\t"
+		"je 1f\n\t"
+		"fs ; movsb\n"
+		"1:\ttestb $2,%%cl\n\t"
+		"je 2f\n\t"
+		"fs ; movsw\n"
+		"2:\tshrl $2,%%ecx\n\t"
+		"rep ; fs ; movsl"
+		:"=&c" (d0),"=&D" (d1),"=&S" (d2)
+		:"0" (n),"1" ((long) to),"2" ((long) from)
+		:"memory");
+}
+
 /*
  * Someone who knows GNU asm better than I should double check the followig.
  * It seems to work, but I don't know if I'm doing something subtly wrong.
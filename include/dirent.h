@@ -0,0 +1,21 @@
+#ifndef _DIRENT_H
+#define _DIRENT_H
+
+#include <sys/types.h>
+
+#define MAXNAMLEN 14
+
+/*
+ * Records returned by getdents(): only live entries, each d_reclen
+ * bytes long (a multiple of 4) with a null-terminated name.
+ */
+struct dirent {
+	long d_ino;
+	off_t d_off;		/* directory offset of the next entry */
+	unsigned short d_reclen;
+	char d_name[MAXNAMLEN+1];
+};
+
+extern int getdents(int fd, struct dirent * dirp, unsigned int count);
+
+#endif
@@ -6,6 +6,19 @@
  * root-device by changing the line ROOT_DEV = XXX in boot/bootsect.s
  */
 
+/*
+ * Mount flags for the root filesystem, MS_NOATIME or MS_RELATIME (see
+ * <linux/fs.h>) if reads should not cause inode writes.
+ */
+#define ROOT_MOUNT_FLAGS 0
+
+/*
+ * Limits of each mounted tmpfs (block major 8): pages of file and
+ * directory data, and inodes (at most 8191).
+ */
+#define TMPFS_PAGES 512
+#define TMPFS_INODES 256
+
 /*
  * define your keyboard here -
  * KBD_FINNISH for Finnish keyboards
@@ -19,9 +19,10 @@
  * 5 - /dev/tty
  * 6 - /dev/lp
  * 7 - unnamed pipes
+ * 8 - tmpfs (no hardware, the minor is the instance)
  */
 
-#define IS_SEEKABLE(x) ((x)>=1 && (x)<=3)
+#define IS_SEEKABLE(x) (((x)>=1 && (x)<=3) || (x)==TMPFS_MAJOR)
 
 #define READ 0
 #define WRITE 1
@@ -33,16 +34,21 @@ void buffer_init(long buffer_end);
 #define MAJOR(a) (((unsigned)(a))>>8)
 #define MINOR(a) ((a)&0xff)
 
+#define TMPFS_MAJOR 8
+#define IS_TMPFS(dev) (MAJOR(dev)==TMPFS_MAJOR)
+
 #define NAME_LEN 14
 #define ROOT_INO 1
 
 #define I_MAP_SLOTS 8
-#define Z_MAP_SLOTS 8
+#define Z_MAP_SLOTS 64		/* v2 volumes can have 512k zones */
 #define SUPER_MAGIC 0x137F
+#define SUPER_MAGIC_V2 0x2468
 
-#define NR_OPEN 20   //进程可以打开文件的最大数
-#define NR_INODE 32
-#define NR_FILE 64  //操作系统可以打开文件的最大数
+#define NR_OPEN 32	/* fds in the task struct, the table grows from there */
+#define NR_OPEN_MAX 1024	/* fds per process */
+#define NR_INODE 256	/* in-core inodes, open() fails with ENFILE past that */
+#define NR_FILE 1024	/* struct files, from a kmem cache */
 #define NR_SUPER 8
 #define NR_HASH 307
 #define NR_BUFFERS nr_buffers
@@ -53,8 +59,18 @@ void buffer_init(long buffer_end);
 #endif
 
 #define INODES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct d_inode)))
+#define V2_INODES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct d2_inode)))
 #define DIR_ENTRIES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct dir_entry)))
 
+/* indirect blocks hold 512 shorts on a v1 fs, 256 longs on v2 */
+#define IND_BITS(v2) ((v2)?8:9)
+#define IND_ZONE(bh,i,v2) ((v2)? \
+	((unsigned long *) (bh)->b_data)[i] : \
+	((unsigned short *) (bh)->b_data)[i])
+#define SET_IND_ZONE(bh,i,v2,nr) do { \
+	if (v2) ((unsigned long *) (bh)->b_data)[i] = (nr); \
+	else ((unsigned short *) (bh)->b_data)[i] = (nr); } while (0)
+
 #define PIPE_HEAD(inode) ((inode).i_zone[0])
 #define PIPE_TAIL(inode) ((inode).i_zone[1])
 #define PIPE_SIZE(inode) ((PIPE_HEAD(inode)-PIPE_TAIL(inode))&(PAGE_SIZE-1))
@@ -73,6 +89,7 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
+	unsigned char b_journal;	/* 1-in running transaction, 2-committing */
 	struct task_struct * b_wait;
 	struct buffer_head * b_prev;
 	struct buffer_head * b_next;
@@ -90,14 +107,31 @@ struct d_inode {
 	unsigned short i_zone[9];
 };
 
+struct d2_inode {
+	unsigned short i_mode;
+	unsigned short i_nlinks;
+	unsigned short i_uid;
+	unsigned short i_gid;
+	unsigned long i_size;
+	unsigned long i_atime;
+	unsigned long i_mtime;
+	unsigned long i_ctime;
+	unsigned long i_zone[10];
+};
+
+/*
+ * The in-memory inode no longer starts with a d_inode: read_inode()
+ * and write_inode() convert field by field for either version.
+ * i_zone[7..9] are the ind, dind and (v2 only) tind zones.
+ */
 struct m_inode {
 	unsigned short i_mode;
 	unsigned short i_uid;
 	unsigned long i_size;
 	unsigned long i_mtime;
-	unsigned char i_gid;
-	unsigned char i_nlinks;
-	unsigned short i_zone[9];
+	unsigned short i_gid;
+	unsigned short i_nlinks;
+	unsigned long i_zone[10];
 /* these are in memory also */
 	struct task_struct * i_wait;
 	unsigned long i_atime;
@@ -111,6 +145,12 @@ struct m_inode {
 	unsigned char i_mount;
 	unsigned char i_seek;
 	unsigned char i_update;
+	unsigned long i_dhash;		/* dir: name index slot, see namei.c */
+	unsigned long i_dfree;		/* dir: no free entry below this one */
+	unsigned long i_tgen;		/* bumped by truncate() */
+	struct m_inode * i_dnext;	/* dirty inode list, see inode.c */
+	struct m_inode ** i_dpprev;
+	struct super_block * i_sb;
 };
 
 struct file {
@@ -119,11 +159,23 @@ struct file {
 	unsigned short f_count;   //文件句柄
 	struct m_inode * f_inode; //指向文件对应的inode
 	off_t f_pos;              //文件位置（读写偏移）
+	unsigned long f_cblock;   //最近一次映射的文件块号
+	unsigned long f_cnr;      //及其逻辑块号，0表示无效
+	unsigned long f_cgen;     //映射时inode的i_tgen
 };
 
+/* bitmaps of fds, see current->open_fds */
+#define FD_ISSET(fd,map) (((map)[(fd)>>5] >> ((fd)&31)) & 1)
+#define FD_SET(fd,map) ((map)[(fd)>>5] |= 1UL << ((fd)&31))
+#define FD_CLR(fd,map) ((map)[(fd)>>5] &= ~(1UL << ((fd)&31)))
+
+/* mount flags, the values are those of later unices */
+#define MS_NOATIME	1024		/* never update access times */
+#define MS_RELATIME	(1<<21)		/* only if older than m/ctime or a day */
+
 struct super_block {
 	unsigned short s_ninodes;
-	unsigned short s_nzones;
+	unsigned long s_nzones;		/* s_zones on a v2 fs */
 	unsigned short s_imap_blocks;
 	unsigned short s_zmap_blocks;
 	unsigned short s_firstdatazone;
@@ -131,8 +183,8 @@ struct super_block {
 	unsigned long s_max_size;
 	unsigned short s_magic;
 /* These are only in memory */
-	struct buffer_head * s_imap[8];
-	struct buffer_head * s_zmap[8];
+	struct buffer_head * s_imap[I_MAP_SLOTS];
+	struct buffer_head * s_zmap[Z_MAP_SLOTS];
 	unsigned short s_dev;
 	struct m_inode * s_isup;
 	struct m_inode * s_imount;
@@ -141,6 +193,9 @@ struct super_block {
 	unsigned char s_lock;
 	unsigned char s_rd_only;
 	unsigned char s_dirt;
+	unsigned long s_flags;		/* MS_xxx given to mount */
+	unsigned char s_version;	/* 1 or 2, from s_magic */
+	struct m_inode * s_journal;	/* /.journal, see journal.c */
 };
 
 struct d_super_block {
@@ -152,6 +207,8 @@ struct d_super_block {
 	unsigned short s_log_zone_size;
 	unsigned long s_max_size;
 	unsigned short s_magic;
+	unsigned short s_state;		/* v2 only from here on */
+	unsigned long s_zones;
 };
 
 //目录项结构
@@ -161,7 +218,6 @@ struct dir_entry {
 };
 
 extern struct m_inode inode_table[NR_INODE];
-extern struct file file_table[NR_FILE];
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head * start_buffer;
 extern int nr_buffers;
@@ -172,32 +228,66 @@ extern int ticks_to_floppy_on(unsigned int dev);
 extern void floppy_on(unsigned int dev);
 extern void floppy_off(unsigned int dev);
 extern void truncate(struct m_inode * inode);
+extern int sync_truncates(int dev);
 extern void sync_inodes(void);
+extern void mark_inode_dirty(struct m_inode * inode);
+extern void mark_inode_clean(struct m_inode * inode);
+extern int update_atime(struct m_inode * inode);
 extern void wait_on(struct m_inode * inode);
 extern int bmap(struct m_inode * inode,int block);
 extern int create_block(struct m_inode * inode,int block);
 extern struct m_inode * namei(const char * pathname);
 extern int open_namei(const char * pathname, int flag, int mode,
 	struct m_inode ** res_inode);
+extern void forget_dir_index(int dev, int nr);
 extern void iput(struct m_inode * inode);
 extern struct m_inode * iget(int dev,int nr);
 extern struct m_inode * get_empty_inode(void);
 extern struct m_inode * get_pipe_inode(void);
+extern struct file * get_empty_filp(void);
+extern void put_filp(struct file * f);
+extern int get_unused_fd(unsigned int start);
+extern void put_unused_fd(unsigned int fd);
+extern int copy_files(struct task_struct * p);
+extern void free_files(struct task_struct * p);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
+extern void ll_rw_page(int rw, int dev, int page, char * buffer);
 extern void brelse(struct buffer_head * buf);
 extern struct buffer_head * bread(int dev,int block);
 extern void bread_page(unsigned long addr,int dev,int b[4]);
 extern struct buffer_head * breada(int dev,int block,...);
+extern int page_in_cache(int dev,int b[4]);
+extern void breada_page(int dev,int b[4]);
 extern int new_block(int dev);
 extern void free_block(int dev, int block);
-extern struct m_inode * new_inode(int dev);
+extern void free_blocks(int dev, int * blocks, int n);
+extern void release_zone(struct super_block * sb, int block);
+extern struct m_inode * new_inode(int dev, int * error);
 extern void free_inode(struct m_inode * inode);
 extern int sync_dev(int dev);
+extern void journal_dirty(struct buffer_head * bh);
+extern void journal_revoke(int dev, int block);
+extern int journal_free(int dev, int block);
+extern int journal_commit(int dev);
+extern int journal_wanted;
+extern void journal_sync(void);
+extern void journal_mount(struct super_block * sb);
+extern void journal_umount(struct super_block * sb);
 extern struct super_block * get_super(int dev);
 extern int ROOT_DEV;
 
+extern int tmpfs_read_super(struct super_block * sb);
+extern void tmpfs_put_super(struct super_block * sb);
+extern int tmpfs_inode_block(struct super_block * sb, int nr);
+extern int tmpfs_bmap(struct m_inode * inode, int block, int create);
+extern void tmpfs_truncate(struct m_inode * inode);
+extern int tmpfs_read(struct m_inode * inode, struct file * filp,
+	char * buf, int count);
+extern int tmpfs_write(struct m_inode * inode, struct file * filp,
+	char * buf, int count);
+
 extern void mount_root(void);
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef _KMEM_H
+#define _KMEM_H
+
+/*
+ * Caches of objects of one type, see lib/kmem.c. A cache is declared
+ * statically with KMEM_CACHE(), the rest is set up on first use.
+ */
+struct kmem_cache {
+	char * name;
+	int size;			/* object size */
+	void (*ctor)(void * obj);	/* run once per object, may be NULL */
+	int (*reclaim)(void);		/* free unused objects, may be NULL */
+	int limit;			/* most objects, 0 if no limit */
+/* these are set up by the allocator */
+	int stride;
+	int link;			/* offset of the free list link */
+	int slab_size;
+	int per_slab;
+	struct kmem_slab * slabs;
+	struct kmem_cache * next;
+/* statistics */
+	int nr_objs, nr_active, nr_slabs;
+	unsigned long nr_allocs, nr_fails;
+};
+
+#define KMEM_CACHE(name,type,ctor,reclaim,limit) \
+	{ (name), sizeof (type), (ctor), (reclaim), (limit) }
+
+extern void * kmem_cache_alloc(struct kmem_cache * c);
+extern void kmem_cache_free(struct kmem_cache * c, void * obj);
+extern int kmem_cache_shrink(struct kmem_cache * c);
+extern int kmem_reclaim(void);
+extern void kmem_stats(void);
+
+#endif
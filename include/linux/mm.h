@@ -4,7 +4,18 @@
 #define PAGE_SIZE 4096
 
 extern unsigned long get_free_page(void);
+extern unsigned long get_free_page_nozero(void);
+extern void zero_idle_page(void);
 extern unsigned long put_page(unsigned long page,unsigned long address);
+extern unsigned long put_dirty_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
+extern void unmap_page_range(unsigned long from,unsigned long size);
+extern unsigned long kmap(unsigned long page);
+extern void kunmap(unsigned long addr);
+
+extern int get_swap_page(void);
+extern void swap_duplicate(int nr);
+extern void swap_free(int nr);
+extern void swap_page(int rw, int nr, unsigned long page);
 
 #endif
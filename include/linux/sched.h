@@ -12,10 +12,6 @@
 #include <linux/mm.h>
 #include <signal.h>
 
-#if (NR_OPEN > 32)
-#error "Currently the close-on-exec-flags are in one word, max 32 files/proc"
-#endif
-
 #define TASK_RUNNING		0
 #define TASK_INTERRUPTIBLE	1
 #define TASK_UNINTERRUPTIBLE	2
@@ -28,6 +24,7 @@
 
 extern int copy_page_tables(unsigned long from, unsigned long to, long size);
 extern int free_page_tables(unsigned long from, unsigned long size);
+extern int release_vfork(void);
 
 extern void sched_init(void);
 extern void schedule(void);
@@ -39,6 +36,19 @@ extern int tty_write(unsigned minor,char * buf,int count);
 
 typedef int (*fn_ptr)();
 
+/*
+ * An mmap()ed area of a task, in data segment addresses (page aligned).
+ * See mm/mmap.c. end == 0 means the slot is free.
+ */
+#define NR_VMA 8
+
+struct vm_area {
+	unsigned long start,end;
+	struct m_inode * inode;		/* NULL: anonymous memory */
+	unsigned long offset;		/* file offset of 'start' */
+	unsigned short prot,flags;	/* PROT_xxx, MAP_xxx */
+};
+
 struct i387_struct {
 	long	cwd;
 	long	swd;
@@ -100,12 +110,20 @@ struct task_struct {
 	struct m_inode * pwd;
 	struct m_inode * root;
 	struct m_inode * executable;
-	unsigned long close_on_exec;
-	struct file * filp[NR_OPEN];
+	struct file ** filp;		/* max_fds entries: fd_array or malloc()ed */
+	unsigned long * open_fds;	/* bitmaps of max_fds bits, */
+	unsigned long * close_on_exec;	/* fd_bits for fd_array */
+	int max_fds,next_fd;		/* no free fd below next_fd */
+	unsigned long fd_bits[2];
+	struct file * fd_array[NR_OPEN];
 /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
 	struct desc_struct ldt[3];
 /* tss for this task */
 	struct tss_struct tss;
+/* mmap()ed areas, not in INIT_TASK */
+	struct vm_area vma[NR_VMA];
+/* the parent, while it lends us its memory (see vfork()) */
+	struct task_struct * vfork_wait;
 };
 
 /*
@@ -120,8 +138,9 @@ struct task_struct {
 /* uid etc */	0,0,0,0,0,0, \
 /* alarm */	0,0,0,0,0,0, \
 /* math */	0, \
-/* fs info */	-1,0022,NULL,NULL,NULL,0, \
-/* filp */	{NULL,}, \
+/* fs info */	-1,0022,NULL,NULL,NULL, \
+/* filp */	init_task.task.fd_array,init_task.task.fd_bits, \
+		init_task.task.fd_bits+1,NR_OPEN,0,{0,0},{NULL,}, \
 	{ \
 		{0,0}, \
 /* ldt */	{0x9f,0xc0fa00}, \
@@ -135,6 +154,10 @@ struct task_struct {
 	}, \
 }
 
+extern struct vm_area * find_vma(struct task_struct * p, unsigned long addr);
+extern struct vm_area * vma_overlap(unsigned long start, unsigned long end);
+extern void exit_mmap(void);
+
 extern struct task_struct *task[NR_TASKS];
 extern struct task_struct *last_task_used_math;
 extern struct task_struct *current;
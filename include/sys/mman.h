@@ -0,0 +1,24 @@
+#ifndef _SYS_MMAN_H
+#define _SYS_MMAN_H
+
+#include <sys/types.h>
+
+#define PROT_READ	0x1
+#define PROT_WRITE	0x2
+#define PROT_EXEC	0x4
+
+#define MAP_SHARED	0x01	/* read-only: never written back */
+#define MAP_PRIVATE	0x02
+#define MAP_FIXED	0x10
+#define MAP_ANONYMOUS	0x20	/* private only */
+
+#define MAP_FAILED	((void *) -1)
+
+/*
+ * The mmap system call takes a pointer to its six arguments:
+ * addr, len, prot, flags, fd and offset, as longs.
+ */
+void * mmap(void * addr, size_t len, int prot, int flags, int fd, off_t off);
+int munmap(void * addr, size_t len);
+
+#endif
@@ -129,6 +129,13 @@
 #define __NR_ssetmask	69
 #define __NR_setreuid	70
 #define __NR_setregid	71
+#define __NR_truncd	72
+#define __NR_sendfile	73
+#define __NR_mmap	74
+#define __NR_munmap	75
+#define __NR_getdents	76
+#define __NR_swapon	77
+#define __NR_vfork	78
 
 #define _syscall0(type,name) \
   type name(void) \
@@ -219,7 +226,7 @@ int kill(pid_t pid, int signal);
 int link(const char * filename1, const char * filename2);
 int lseek(int fildes, off_t offset, int origin);
 int mknod(const char * filename, mode_t mode, dev_t dev);
-int mount(const char * specialfile, const char * dir, int rwflag);
+int mount(const char * specialfile, const char * dir, int flags);
 int nice(int val);
 int open(const char * filename, int flag, ...);
 static int pause(void);
@@ -250,5 +257,7 @@ int dup2(int oldfd, int newfd);
 int getppid(void);
 pid_t getpgrp(void);
 pid_t setsid(void);
+/* the sendfile system call takes a pointer to its four arguments, as longs */
+int sendfile(int out_fd, int in_fd, off_t * offset, int count);
 
 #endif
@@ -32,6 +32,7 @@ static inline _syscall0(int,fork)
 static inline _syscall0(int,pause)
 static inline _syscall1(int,setup,void *,BIOS)
 static inline _syscall0(int,sync)
+static inline _syscall0(int,truncd)
 
 #include <linux/tty.h>
 #include <linux/sched.h>
@@ -65,8 +66,18 @@ extern long startup_time;
  */
 #define EXT_MEM_K (*(unsigned short *)0x90002)
 #define DRIVE_INFO (*(struct drive_info *)0x90080)
+#define E820_MAP ((struct e820entry *)0x900A0)
+#define E820_NR (*(unsigned char *)0x901E0)
 #define ORIG_ROOT_DEV (*(unsigned short *)0x901FC)
 
+struct e820entry {
+	unsigned long long addr;
+	unsigned long long size;
+	unsigned long type;		/* 1 = usable RAM */
+};
+
+#define MAX_MEMORY 0x40000000	/* 1GB: mem_map[] is 256kB */
+
 /*
  * Yeah, yeah, it's ugly, but I cannot find how to do this correctly
  * and this seems to work. I anybody has more info on the real-time
@@ -109,6 +120,24 @@ static long main_memory_start = 0;
 
 struct drive_info { char dummy[32]; } drive_info;
 
+/*
+ * The end of the RAM that starts at 1MB: from the BIOS memory map if
+ * there is one, else what int 0x15 ah=0x88 said (at most 64MB).
+ */
+static long get_memory_end(void)
+{
+	unsigned long long end = (1<<20) + (EXT_MEM_K<<10);
+	int i;
+
+	for (i=0 ; i<E820_NR ; i++)
+		if (E820_MAP[i].type == 1 && E820_MAP[i].addr <= (1<<20) &&
+		    E820_MAP[i].addr + E820_MAP[i].size > (1<<20))
+			end = E820_MAP[i].addr + E820_MAP[i].size;
+	if (end > MAX_MEMORY)
+		end = MAX_MEMORY;
+	return end & 0xfffff000;
+}
+
 void main(void)		/* This really IS void, no error here. */
 {			/* The startup routine assumes (well, ...) this */
 /*
@@ -117,10 +146,7 @@ void main(void)		/* This really IS void, no error here. */
  */
  	ROOT_DEV = ORIG_ROOT_DEV;
  	drive_info = DRIVE_INFO;
-	memory_end = (1<<20) + (EXT_MEM_K<<10);
-	memory_end &= 0xfffff000;
-	if (memory_end > 16*1024*1024)
-		memory_end = 16*1024*1024;
+	memory_end = get_memory_end();
 	if (memory_end > 12*1024*1024) 
 		buffer_memory_end = 4*1024*1024;
 	else if (memory_end > 6*1024*1024)
@@ -151,7 +177,8 @@ void main(void)		/* This really IS void, no error here. */
  * signal to awaken, but task0 is the sole exception (see 'schedule()')
  * as task 0 gets activated at every idle moment (when no other tasks
  * can run). For task0 'pause()' just means we go check if some other
- * task can run, and if not we return here.
+ * task can run, and if not we return here. On the way, it clears a
+ * free page for get_free_page() (see 'zero_idle_page()').
  */
 	for(;;) pause();
 }
@@ -180,6 +207,8 @@ void init(void)
     // "格式化"虚拟盘并用虚拟盘取代软盘为根设备，
     // 并在虚拟盘上加载根文件系统
 	setup((void *) &drive_info);
+	if (!fork())		/* frees the blocks of removed files */
+		_exit(truncd());
     //执行open时产生软中断，并最终映射到内核中sys_open函数去执行
 	(void) open("/dev/tty0",O_RDWR,0); //创建标准输入设备，其中/dev/tty0是该文件的路径名
 	(void) dup(0); //复制句柄，创建标准输出设备 dup（）函数最终会映射到 sys_dup（）这个系统调用函数中
@@ -115,8 +115,8 @@ static inline void end_request(int uptodate)
 	}
 	if (!uptodate) {
 		printk(DEVICE_NAME " I/O error\n\r");
-		printk("dev %04x, block %d\n\r",CURRENT->dev,
-			CURRENT->bh->b_blocknr);
+		printk("dev %04x, sector %d\n\r",CURRENT->dev,
+			CURRENT->sector);
 	}
 	wake_up(&CURRENT->waiting);
 	wake_up(&wait_for_request);
@@ -105,8 +105,10 @@ int do_exit(long code)
 {
 	int i;
     //释放shell进程的代码段和数据段所占据的内存页面
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	if (!release_vfork()) {
+		free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
+		free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	}
 
     //检测shell进程是否有子进程
 	for (i=0 ; i<NR_TASKS ; i++)
@@ -120,15 +122,17 @@ int do_exit(long code)
 		}
 
     //解除shell进程与其他进程，文件，终端等关系
-	for (i=0 ; i<NR_OPEN ; i++)
+	for (i=0 ; i<current->max_fds ; i++)
 		if (current->filp[i])
 			sys_close(i);
+	free_files(current);
 	iput(current->pwd);
 	current->pwd=NULL;
 	iput(current->root);
 	current->root=NULL;
 	iput(current->executable);
 	current->executable=NULL;
+	exit_mmap();
 	if (current->leader && current->tty >= 0)
 		tty_table[current->tty].pgrp = 0;
 	if (last_task_used_math == current)
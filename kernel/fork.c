@@ -66,10 +66,39 @@ int copy_mem(int nr,struct task_struct * p)
 	return 0;
 }
 
+/*
+ * vfork() lends the memory of the parent to the child instead of
+ * copying its page tables: the child runs in the parent's linear
+ * address space, and the parent sleeps until the child gives it back
+ * by exec() or exit(). Until then the child mustn't do anything else
+ * with its memory, nor return from the function that called vfork(),
+ * as it shares the stack too: vfork() has to be an inline _syscall0.
+ *
+ * release_vfork() gives the memory back. The child then gets its own
+ * (empty) 64MB slot, for exec() to fill.
+ */
+int release_vfork(void)
+{
+	unsigned long base;
+	int nr;
+
+	if (!current->vfork_wait)
+		return 0;
+	for (nr=0 ; task[nr] != current ; nr++)
+		/* nothing */ ;
+	base = nr * 0x4000000;
+	current->start_code = base;
+	set_base(current->ldt[1],base);
+	set_base(current->ldt[2],base);
+	wake_up(&current->vfork_wait);
+	return 1;
+}
+
 /*
  *  Ok, this is the main fork-routine. It copies the system process
  * information (task[nr]) and sets up the necessary registers. It
- * also copies the data segment in it's entirety.
+ * also copies the data segment in it's entirety, unless 'vfork' is
+ * set: then the child borrows it, and we wait for it back.
  */
 // 复制进程
 // 该函数的参数进入系统调用中断处理过程开始，直到调用本系统调用处理过程
@@ -79,13 +108,14 @@ int copy_mem(int nr,struct task_struct * p)
 // 2. 在刚进入system_call时压入栈的段寄存器ds、es、fs和edx、ecx、ebx；
 // 3. 调用sys_call_table中sys_fork函数时压入栈的返回地址(用参数none表示)；
 // 4. 在调用copy_process()分配TASK数组下标。
-int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
+// 5. sys_fork压入的0或sys_vfork压入的1(vfork)。
+int copy_process(int vfork,int nr,long ebp,long edi,long esi,long gs,long none,
                  long ebx,long ecx,long edx,
                  long fs,long es,long ds,
                  long eip,long cs,long eflags,long esp,long ss)
 {
     struct task_struct *p;
-    int i;
+    int i,pid;
     struct file *f;
 
     // 首先为新任务数据结构分配内存。如果内存分配出错，则返回出错码并退出。
@@ -112,6 +142,7 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
     p->utime = p->stime = 0;        // 用户态时间和和心态运行时间
     p->cutime = p->cstime = 0;      // 子进程用户态和和心态运行时间
     p->start_time = jiffies;        // 进程开始运行时间(当前时间滴答数)
+    p->vfork_wait = NULL;
     // 再修改任务状态段TSS数据，由于系统给任务结构p分配了1页新内存，所以(PAGE_SIZE+
     // (long)p)让esp0正好指向该页顶端。ss0:esp0用作程序在内核态执行时的栈。另外，
     // 每个任务在GDT表中都有两个段描述符，一个是任务的TSS段描述符，另一个是任务的LDT
@@ -150,15 +181,21 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
     // 接下来复制进程页表。即在线性地址空间中设置新任务代码段和数据段描述符中的基址和限长，
     // 并复制页表。如果出错(返回值不是0)，则复位任务数组中相应项并释放为该新任务分配的用于
     // 任务结构的内存页。
-    if (copy_mem(nr,p)) {
+    if (copy_files(p)) {
+        task[nr] = NULL;
+        free_page((long) p);
+        return -EAGAIN;
+    }
+    if (!vfork && copy_mem(nr,p)) {
         task[nr] = NULL;
+        free_files(p);
         free_page((long) p);
         return -EAGAIN;
     }
     // 如果父进程中有文件是打开的，则将对应文件的打开次数增1，因为这里创建的子进程会与父
     // 进程共享这些打开的文件。将当前进程(父进程)的pwd，root和executable引用次数均增1.
     // 与上面同样的道理，子进程也引用了这些i节点。
-    for (i=0; i<NR_OPEN;i++)
+    for (i=0; i<p->max_fds;i++)
         if ((f=p->filp[i]))
             f->f_count++;
     if (current->pwd)
@@ -167,6 +204,9 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
         current->root->i_count++;
     if (current->executable)
         current->executable->i_count++;
+    for (i=0; i<NR_VMA; i++)
+        if (p->vma[i].end && p->vma[i].inode)
+            p->vma[i].inode->i_count++;
     // 随后GDT表中设置新任务TSS段和LDT段描述符项。这两个段的限长均被设置成104字节。
     // set_tss_desc()和set_ldt_desc()在system.h中定义。"gdt+(nr<<1)+FIRST_TSS_ENTRY"是
     // 任务nr的TSS描述符项在全局表中的地址。因为每个任务占用GDT表中2项，因此上式中
@@ -175,7 +215,10 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
     set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss)); //设置GDT中与子进程相关的项，看sched.c
     set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
     p->state = TASK_RUNNING;	/* do this last, just in case 设置子进程为就绪 */
-    return last_pid;
+    pid = p->pid;
+    if (vfork)
+        sleep_on(&p->vfork_wait);	/* until release_vfork() */
+    return pid;
 }
 // 为新进程取得不重复的进程号last_pid.函数返回在task数组中的数组下标。
 int find_empty_process(void)
@@ -12,6 +12,7 @@
  */
 #include <linux/sched.h>
 #include <linux/kernel.h>
+#include <linux/kmem.h>
 #include <linux/sys.h>
 #include <linux/fdreg.h>
 #include <asm/system.h>
@@ -41,6 +42,7 @@ void show_stat(void)
 	for (i=0;i<NR_TASKS;i++)
 		if (task[i])
 			show_task(i,task[i]);
+	kmem_stats();
 }
 
 #define LATCH (1193180/HZ)
@@ -148,6 +150,8 @@ void schedule(void)
 
 int sys_pause(void)
 {
+	if (current == task[0])
+		zero_idle_page();
 	current->state = TASK_INTERRUPTIBLE;
 	schedule();
 	return 0;
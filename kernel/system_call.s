@@ -58,13 +58,13 @@ sa_mask = 4
 sa_flags = 8
 sa_restorer = 12
 
-nr_system_calls = 72
+nr_system_calls = 79
 
 /*
  * Ok, I get parallel printer interrupts while using the floppy for some
  * strange reason. Urgel. Now I just ignore them.
  */
-.globl system_call,sys_fork,timer_interrupt,sys_execve
+.globl system_call,sys_fork,sys_vfork,timer_interrupt,sys_execve
 .globl hd_interrupt,floppy_interrupt,parallel_interrupt
 .globl device_not_available, coprocessor_error
 
@@ -93,7 +93,10 @@ system_call:
 	mov %dx,%fs
 	call *sys_call_table(,%eax,4)
 	pushl %eax
-	movl current,%eax
+	cmpl $0,journal_wanted		# a transaction is getting full:
+	je 1f				# commit it now that the call is done
+	call journal_sync
+1:	movl current,%eax
 	cmpl $0,state(%eax)		# state
 	jne reschedule
 	cmpl $0,counter(%eax)		# counter
@@ -215,9 +218,25 @@ sys_fork:
 	pushl %edi
 	pushl %ebp
 	pushl %eax
+	pushl $0
 	call copy_process
-	addl $20,%esp #/*copy_process返回至此，esp+=20就是esp清20字节的栈，也就是清前面压的gs、esi*/
-1:	ret #/*edi、ebp、eax，注意：内核栈里还有数据。返回_system_call中的pushl%eax执行*/
+	addl $24,%esp #/*copy_process返回至此，esp+=24就是esp清24字节的栈，也就是清前面压的gs、esi*/
+1:	ret #/*edi、ebp、eax、0，注意：内核栈里还有数据。返回_system_call中的pushl%eax执行*/
+
+.align 2
+sys_vfork:
+	call find_empty_process
+	testl %eax,%eax
+	js 1f
+	push %gs
+	pushl %esi
+	pushl %edi
+	pushl %ebp
+	pushl %eax
+	pushl $1
+	call copy_process
+	addl $24,%esp
+1:	ret
 
 hd_interrupt:
 	pushl %eax  #文件系统的中断命令,保存CPU的状态
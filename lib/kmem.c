@@ -0,0 +1,202 @@
+/*
+ * kmem.c --- caches of kernel objects, on top of malloc()
+ *
+ * A cache hands out objects of one type. It gets them a slab at a
+ * time from malloc(): a slab is a block of a power of two bytes, from
+ * 256 to a whole page, that starts with a struct kmem_slab and is
+ * followed by as many objects as fit. malloc() carves its buckets out
+ * of whole pages, so a slab is aligned on its own size, and the slab
+ * an object belongs to is found by masking its address.
+ *
+ * Each slab keeps a list of its free objects. The link is kept in the
+ * first word of a free object, or, if the cache has a constructor, in
+ * an extra word after it: the constructor runs once when the slab is
+ * made, and an object is expected to be given back in the state the
+ * constructor left it in.
+ *
+ * A slab that becomes empty is given back to malloc(), unless it is
+ * the only free room the cache has. kmem_reclaim() is for when memory
+ * runs low: it asks each cache to free what it can spare, and gives
+ * back all empty slabs.
+ */
+
+#include <stddef.h>
+
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/kmem.h>
+#include <asm/system.h>
+
+struct kmem_slab {
+	struct kmem_slab * next;
+	void * free;
+	int inuse;
+};
+
+#define MIN_SLAB 256
+#define MIN_OBJS 8	/* a slab smaller than a page holds at least this */
+
+#define LINK(c,obj) (*(void **) ((char *) (obj) + (c)->link))
+#define SLAB_OF(c,obj) \
+	((struct kmem_slab *) ((unsigned long) (obj) & ~((c)->slab_size-1)))
+
+static struct kmem_cache * kmem_caches = NULL;
+
+static void setup_cache(struct kmem_cache * c)
+{
+	int size = (c->size + 3) & ~3;
+
+	if (!size)
+		size = 4;
+	if (c->ctor) {
+		c->link = size;
+		c->stride = size + 4;
+	} else {
+		c->link = 0;
+		c->stride = size;
+	}
+	for (c->slab_size = MIN_SLAB ; c->slab_size < PAGE_SIZE ;
+	     c->slab_size <<= 1)
+		if ((c->slab_size - sizeof (struct kmem_slab)) / c->stride
+		    >= MIN_OBJS)
+			break;
+	c->per_slab = (c->slab_size - sizeof (struct kmem_slab)) / c->stride;
+	if (!c->per_slab) {
+		printk("kmem: %s objects are too large (%d)\n\r",c->name,
+			c->size);
+		panic("kmem: bad cache");
+	}
+	c->next = kmem_caches;
+	kmem_caches = c;
+}
+
+static struct kmem_slab * new_slab(struct kmem_cache * c)
+{
+	struct kmem_slab * s;
+	char * obj;
+	int i;
+
+	if (!(s = (struct kmem_slab *) malloc(c->slab_size)))
+		return NULL;
+	if (s != SLAB_OF(c,s))
+		panic("kmem: misaligned slab");
+	s->next = NULL;
+	s->free = NULL;
+	s->inuse = 0;
+	obj = (char *) (s+1) + (c->per_slab-1) * c->stride;
+	for (i = c->per_slab ; i-- ; obj -= c->stride) {
+		if (c->ctor)
+			c->ctor(obj);
+		LINK(c,obj) = s->free;
+		s->free = obj;
+	}
+	return s;
+}
+
+/* unlink an empty slab; called with interrupts off */
+static void unlink_slab(struct kmem_cache * c, struct kmem_slab * s)
+{
+	struct kmem_slab ** p;
+
+	for (p = &c->slabs ; *p ; p = &(*p)->next)
+		if (*p == s) {
+			*p = s->next;
+			c->nr_slabs--;
+			c->nr_objs -= c->per_slab;
+			return;
+		}
+	panic("kmem: slab chains corrupted");
+}
+
+void * kmem_cache_alloc(struct kmem_cache * c)
+{
+	struct kmem_slab * s;
+	void * obj;
+
+	if (!c->slab_size)
+		setup_cache(c);
+	cli();
+	for (s = c->slabs ; s ; s = s->next)
+		if (s->free)
+			break;
+	if (!s) {
+		sti();
+		if ((c->limit && c->nr_objs >= c->limit) || !(s = new_slab(c))) {
+			c->nr_fails++;
+			return NULL;
+		}
+		cli();
+		s->next = c->slabs;
+		c->slabs = s;
+		c->nr_slabs++;
+		c->nr_objs += c->per_slab;
+	}
+	obj = s->free;
+	s->free = LINK(c,obj);
+	s->inuse++;
+	c->nr_active++;
+	c->nr_allocs++;
+	sti();
+	return obj;
+}
+
+void kmem_cache_free(struct kmem_cache * c, void * obj)
+{
+	struct kmem_slab * s = SLAB_OF(c,obj);
+
+	cli();
+	LINK(c,obj) = s->free;
+	s->free = obj;
+	c->nr_active--;
+	if (--s->inuse || c->nr_objs - c->nr_active <= c->per_slab) {
+		sti();
+		return;
+	}
+	unlink_slab(c,s);
+	sti();
+	free_s(s,c->slab_size);
+}
+
+/* give back the empty slabs of a cache, returns how many */
+int kmem_cache_shrink(struct kmem_cache * c)
+{
+	struct kmem_slab * s;
+	int n = 0;
+
+repeat:
+	cli();
+	for (s = c->slabs ; s ; s = s->next)
+		if (!s->inuse) {
+			unlink_slab(c,s);
+			sti();
+			free_s(s,c->slab_size);
+			n++;
+			goto repeat;
+		}
+	sti();
+	return n;
+}
+
+int kmem_reclaim(void)
+{
+	struct kmem_cache * c;
+	int n = 0;
+
+	for (c = kmem_caches ; c ; c = c->next) {
+		if (c->reclaim)
+			c->reclaim();
+		n += kmem_cache_shrink(c);
+	}
+	return n;
+}
+
+void kmem_stats(void)
+{
+	struct kmem_cache * c;
+
+	printk("cache     size active  objs slabs   allocs fails\n\r");
+	for (c = kmem_caches ; c ; c = c->next)
+		printk("%-8s %5d %6d %5d %5d %8d %5d\n\r",c->name,c->size,
+			c->nr_active,c->nr_objs,c->nr_slabs,c->nr_allocs,
+			c->nr_fails);
+}
@@ -36,6 +36,8 @@
  *	"pre-allocated" so that it can safely draw upon those pages if
  * 	it is called from an interrupt routine.
  *
+ *	When there is no free page left, malloc() returns NULL.
+ *
  * 	Another concern is that get_free_page() should not sleep; if it 
  *	does, the code is carefully ordered so as to avoid any race 
  *	conditions.  The catch is that if malloc() is called re-entrantly, 
@@ -101,7 +103,7 @@ static inline void init_bucket_desc()
 	
 	first = bdesc = (struct bucket_desc *) get_free_page();
 	if (!bdesc)
-		panic("Out of memory in init_bucket_desc()");
+		return;
 	for (i = PAGE_SIZE/sizeof(struct bucket_desc); i > 1; i--) {
 		bdesc->next = bdesc+1;
 		bdesc++;
@@ -149,13 +151,15 @@ void *malloc(unsigned int len)
 
 		if (!free_bucket_desc)	
 			init_bucket_desc();
+		if (!free_bucket_desc || !(cp = (char *) get_free_page())) {
+			sti();
+			return (void *) 0;	/* out of memory */
+		}
 		bdesc = free_bucket_desc;
 		free_bucket_desc = bdesc->next;
 		bdesc->refcnt = 0;
 		bdesc->bucket_size = bdir->size;
-		bdesc->page = bdesc->freeptr = (void *) (cp = (char *) get_free_page());
-		if (!cp)
-			panic("Out of memory in kernel malloc()");
+		bdesc->page = bdesc->freeptr = (void *) cp;
 		/* Set up the chain of free objects */
 		for (i=PAGE_SIZE/bdir->size; i > 1; i--) {
 			*((char **) cp) = cp + bdir->size;
@@ -21,12 +21,15 @@
  */
 
 #include <signal.h>
+#include <sys/mman.h>
 
 #include <asm/system.h>
 
 #include <linux/sched.h>
 #include <linux/head.h>
 #include <linux/kernel.h>
+#include <linux/kmem.h>
+#include <linux/mm.h>
 
 void do_exit(long code);
 
@@ -39,51 +42,168 @@ static inline void oom(void)
 #define invalidate() \
 __asm__("movl %%eax,%%cr3"::"a" (0))
 
+/*
+ * A 486 or later can flush the tlb entry of just one page with invlpg,
+ * a 386 has to flush it all. mem_init() finds out which. Changes to a
+ * page directory entry cover 4MB, and use invalidate().
+ */
+static int has_invlpg = 0;
+
+#define invalidate_page(addr) do { \
+if (has_invlpg) \
+	__asm__ __volatile__("invlpg %0"::"m" (*(char *) (addr))); \
+else \
+	invalidate(); } while (0)
+
+/* ranges of more than this many pages are flushed all at once */
+#define INVLPG_MAX 32
+
 /* these are not to be changed without changing head.s etc */
 #define LOW_MEM 0x100000
-#define PAGING_MEMORY (15*1024*1024)
-#define PAGING_PAGES (PAGING_MEMORY>>12)
+#define DIRECT_MEM 0x3c00000	/* memory below this is identity mapped */
+#define KMAP_BASE DIRECT_MEM	/* the kmap() window is the 4MB above */
+#define NR_KMAP 16
 #define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
 #define USED 100
+#define FIRST_VM_PAGE (0x4000000>>12)	/* task 0 is never swapped */
+#define FREE_RESERVE 16		/* kept for get_free_page() by swapping */
+#define ZERO_POOL 64		/* cleared pages kept by the idle task */
+
+#define PAGE_ACCESSED 0x20
+#define PAGE_DIRTY 0x40
 
 #define CODE_SPACE(addr) ((((addr)+4095)&~4095) < \
 current->start_code + current->end_code)
 
 static long HIGH_MEMORY = 0;
+static long DIRECT_END = 0;	/* min(HIGH_MEMORY,DIRECT_MEM) */
+
+#define copy_page(from,to) do { int d0,d1,d2; \
+__asm__ __volatile__("cld ; rep ; movsl" \
+	:"=&S" (d0),"=&D" (d1),"=&c" (d2) \
+	:"0" (from),"1" (to),"2" (1024):"memory"); } while (0)
+
+/* one byte per page from LOW_MEM to HIGH_MEMORY, set up by mem_init() */
+static unsigned char * mem_map = NULL;
+static long paging_pages = 0;
+
+/*
+ * The free pages below DIRECT_END are also on a list, linked through
+ * their first long, so that neither getting nor freeing a page looks
+ * through mem_map[]. mem_init() puts the highest pages first, as the
+ * old scan did. Pages above DIRECT_END can't be written to that way:
+ * they are kept on a stack of addresses instead.
+ */
+static unsigned long free_list = 0;
+static unsigned long * high_free = NULL;
+static long nr_high_free = 0;
+static long nr_free_pages = 0;
+
+/*
+ * Up to ZERO_POOL of the free direct pages have been cleared by the
+ * idle task, see zero_idle_page(), and are on a list of their own. Only
+ * their first long, the link, has to be cleared when one is taken.
+ * nr_free_pages counts them too.
+ */
+static unsigned long zero_list = 0;
+static long nr_zero_pages = 0;
+
+#define clear_page(addr) do { int d0,d1; \
+__asm__ __volatile__("cld ; rep ; stosl" \
+	:"=&c" (d0),"=&D" (d1) \
+	:"a" (0),"0" (1024),"1" (addr) \
+	:"memory"); } while (0)
 
-#define copy_page(from,to) \
-__asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024))
+/* a page from the cleared pool, 0 if it is empty */
+static unsigned long get_zero_page(void)
+{
+	unsigned long page;
 
-static unsigned char mem_map [ PAGING_PAGES ] = {0,};
+	if (!(page = zero_list))
+		return 0;
+	zero_list = *(unsigned long *) page;
+	*(unsigned long *) page = 0;
+	nr_zero_pages--;
+	nr_free_pages--;
+	mem_map[MAP_NR(page)] = 1;
+	return page;
+}
 
 /*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
- * get_free_page()函数用于在主内存区中申请一页空闲内存页，并返回物理内存
-* 页的起始地址。它首先扫描内存页面字节图数组 mem_map[]，寻找值是 0 的字节项（对应空闲页面）。
-* 若无则返回 0 结束，表示物理内存已使用完。若找到值为 0 的字节，则将其置 1，并换算出对应空闲页
-* 面的起始地址。然后对该内存页面作清零操作，并且最后返回该空闲页面的物理内存起始地址。
+ * Get physical address of a free page and mark it used, without
+ * clearing it: for callers that fill the whole page anyway. If no free
+ * pages left, return 0.
+ * 从空闲页链表头取出一页，引用计数置1，不清零。
+ */
+unsigned long get_free_page_nozero(void)
+{
+	unsigned long page;
+
+	if (!(page = free_list))
+		return get_zero_page();
+	free_list = *(unsigned long *) page;
+	nr_free_pages--;
+	mem_map[MAP_NR(page)] = 1;
+	return page;
+}
+
+/*
+ * Get physical address of a free page, cleared, and mark it used. If no
+ * free pages left, return 0.
  */
 unsigned long get_free_page(void)
 {
-register unsigned long __res asm("ax");
+	unsigned long page;
 
-__asm__("std ; repne ; scasb\n\t" // 反向扫描串（mem map[]），al（0）与di不等则重复（找引用对数为0的项）
-	"jne 1f\n\t" /*找不到空闲页，跳转到1*/
-	"movb $1,1(%%edi)\n\t"  /*将1赋给edi+1的位置，在mem_map[]中，将找到0项的引用计数置为1*/
-	"sall $12,%%ecx\n\t"
-	"addl %2,%%ecx\n\t"
-	"movl %%ecx,%%edx\n\t"
-	"movl $1024,%%ecx\n\t"
-	"leal 4092(%%edx),%%edi\n\t"
-	"rep ; stosl\n\t"
-	" movl %%edx,%%eax\n"
-	"1: cld"
-	:"=a" (__res)
-	:"0" (0),"i" (LOW_MEM),"c" (PAGING_PAGES),
-	"D" (mem_map+PAGING_PAGES-1)
-	);
-return __res;
+	if ((page = get_zero_page()))
+		return page;
+	if ((page = get_free_page_nozero()))
+		clear_page(page);
+	return page;
+}
+
+/*
+ * Called by task 0 when there is nothing else to do: clear one free
+ * page for the pool. One page at a time, so that a task woken up by an
+ * interrupt meanwhile doesn't have to wait long.
+ */
+void zero_idle_page(void)
+{
+	unsigned long page;
+
+	if (nr_zero_pages >= ZERO_POOL || !(page = free_list))
+		return;
+	free_list = *(unsigned long *) page;
+	clear_page(page);
+	*(unsigned long *) page = zero_list;
+	zero_list = page;
+	nr_zero_pages++;
+}
+
+static int swap_out(void);
+
+/*
+ * A page for user space, not cleared. It comes from above DIRECT_END
+ * if there is any memory left there, so it must be reached through
+ * kmap(). When memory runs low, the kmem caches give back what they
+ * can spare and user pages are swapped out, so that get_free_page(),
+ * which must not sleep, still finds some: this may sleep.
+ */
+static unsigned long get_user_page(void)
+{
+	unsigned long page;
+
+	if (nr_free_pages < FREE_RESERVE)
+		kmem_reclaim();
+	while (nr_free_pages < FREE_RESERVE)
+		if (!swap_out())
+			break;
+	if (!nr_high_free)
+		return get_free_page_nozero();
+	page = high_free[--nr_high_free];
+	nr_free_pages--;
+	mem_map[MAP_NR(page)] = 1;
+	return page;
 }
 
 /*
@@ -92,14 +212,264 @@ return __res;
  */
 void free_page(unsigned long addr)
 {
+	int nr;
+
 	if (addr < LOW_MEM) return;
 	if (addr >= HIGH_MEMORY)
 		panic("trying to free nonexistent page");
-	addr -= LOW_MEM;
-	addr >>= 12;
-	if (mem_map[addr]--) return;
-	mem_map[addr]=0;
-	panic("trying to free free page");
+	nr = MAP_NR(addr);
+	if (!mem_map[nr])
+		panic("trying to free free page");
+	if (--mem_map[nr])
+		return;
+	addr &= 0xfffff000;
+	if (addr >= DIRECT_END)
+		high_free[nr_high_free++] = addr;
+	else {
+		*(unsigned long *) addr = free_list;
+		free_list = addr;
+	}
+	nr_free_pages++;
+}
+
+/*
+ * The kernel reaches a page above DIRECT_END by mapping it in one of
+ * NR_KMAP slots just above, where its data segment still reaches. It
+ * may sleep with the page mapped, so kmap() sleeps too if all slots
+ * are taken. Direct pages are simply returned as they are.
+ */
+static unsigned long * kmap_table = NULL;
+static struct task_struct * kmap_wait = NULL;
+
+unsigned long kmap(unsigned long page)
+{
+	int i;
+
+	if (page < DIRECT_END)
+		return page;
+	for (;;) {
+		for (i=0 ; i<NR_KMAP ; i++)
+			if (!kmap_table[i]) {
+				kmap_table[i] = page | 3;
+				invalidate_page(KMAP_BASE + (i<<12));
+				return KMAP_BASE + (i<<12);
+			}
+		sleep_on(&kmap_wait);
+	}
+}
+
+void kunmap(unsigned long addr)
+{
+	if (addr < KMAP_BASE)
+		return;
+	kmap_table[(addr-KMAP_BASE)>>12] = 0;
+	wake_up(&kmap_wait);
+}
+
+static void clear_user_page(unsigned long page)
+{
+	unsigned long addr = kmap(page);
+
+	clear_page(addr);
+	kunmap(addr);
+}
+
+/*
+ * Swapping. A present user page that hasn't been accessed since the
+ * clock hand last went past it is taken away. A clean one is simply
+ * freed, as do_no_page() can load it again, or clear it if it was
+ * never written. A dirty one is written to a swap page, whose number,
+ * shifted left by one to keep the present bit clear, takes its place
+ * in the page table. Dirty pages shared after a fork() stay.
+ *
+ * Only one page is written out at a time, and swap_in() waits for it:
+ * the swap page mustn't be read before it has been written.
+ */
+static int swap_writing = 0;
+static struct task_struct * swap_wait = NULL;
+
+/*
+ * A shared page table is also mapped at the addresses of the other
+ * tasks using it: it needs a full flush.
+ */
+static void invalidate_entry(unsigned long * table_ptr,unsigned long address)
+{
+	if (mem_map[MAP_NR(0xfffff000 & (unsigned long) table_ptr)] > 1)
+		invalidate();
+	else
+		invalidate_page(address);
+}
+
+static int try_to_swap_out(unsigned long * table_ptr,unsigned long address)
+{
+	unsigned long page = *table_ptr;
+	int nr;
+
+	if (!(page & 1))
+		return 0;
+	page &= 0xfffff000;
+	if (page < LOW_MEM || page >= HIGH_MEMORY)
+		return 0;
+	if (*table_ptr & PAGE_ACCESSED) {
+		*table_ptr &= ~PAGE_ACCESSED;
+		return 0;
+	}
+	if (!(*table_ptr & PAGE_DIRTY)) {
+		*table_ptr = 0;
+		invalidate_entry(table_ptr,address);
+		free_page(page);
+		return 1;
+	}
+	if (mem_map[MAP_NR(page)] != 1 || !(nr = get_swap_page()))
+		return 0;
+	*table_ptr = nr << 1;
+	invalidate_entry(table_ptr,address);
+	swap_writing = nr;
+	swap_page(WRITE,nr,page);
+	swap_writing = 0;
+	wake_up(&swap_wait);
+	free_page(page);
+	return 1;
+}
+
+/*
+ * Go round the page tables of tasks 1 and up, at most twice, looking
+ * for a page to swap out. The accessed bits cleared on the way are set
+ * again by the cpu only after the tlb has been flushed.
+ */
+static int swap_out(void)
+{
+	static unsigned long hand = FIRST_VM_PAGE;
+	unsigned long * pg_table;
+	long count = 2*(1024*1024 - FIRST_VM_PAGE);
+
+	while (swap_writing)
+		sleep_on(&swap_wait);
+	while (count > 0) {
+		if (hand >= 1024*1024)
+			hand = FIRST_VM_PAGE;
+		if (!(1 & pg_dir[hand>>10])) {
+			count -= 1024 - (hand & 1023);
+			hand = (hand | 1023) + 1;
+			continue;
+		}
+		pg_table = (unsigned long *) (0xfffff000 & pg_dir[hand>>10]) +
+			(hand & 1023);
+		count--;
+		if (try_to_swap_out(pg_table,hand++ << 12))
+			return 1;
+	}
+	invalidate();
+	return 0;
+}
+
+/* read swap page 'nr' into a new page, 0 if out of memory */
+static unsigned long read_swapped(int nr)
+{
+	unsigned long page;
+
+	while (swap_writing == nr)
+		sleep_on(&swap_wait);
+	if (!(page = get_user_page()))
+		return 0;
+	swap_page(READ,nr,page);
+	return page;
+}
+
+/* the page table entry 'table_ptr' is swapped out: get it back */
+static void swap_in(unsigned long * table_ptr)
+{
+	unsigned long page;
+	int nr = *table_ptr >> 1;
+
+	if (!(page = read_swapped(nr)))
+		oom();
+	*table_ptr = page | PAGE_DIRTY | PAGE_ACCESSED | 7;
+	swap_free(nr);
+}
+
+/*
+ * Page tables are shared after a fork(), see copy_page_tables(): their
+ * mem_map[] count is the number of page directory entries that point
+ * to them, and those entries are read-only, so that the first write to
+ * the 4MB finds it out. The pages of a shared page table are counted
+ * once, for the table. Anything that changes the entries of a page
+ * table (but swapping, which changes them the same for every sharer)
+ * must first get a table of its own with unshare_table().
+ */
+
+/* drop a page table: with the last user, its pages go too */
+static void free_table(unsigned long table)
+{
+	unsigned long * pg_table = (unsigned long *) table;
+	int nr;
+
+	if (mem_map[MAP_NR(table)] == 1)
+		for (nr=0 ; nr<1024 ; nr++,pg_table++) {
+			if (1 & *pg_table)
+				free_page(0xfffff000 & *pg_table);
+			else if (*pg_table)
+				swap_free(*pg_table >> 1);
+			*pg_table = 0;
+		}
+	free_page(table);
+}
+
+/*
+ * Copy 'nr' entries of a page table, write-protecting the pages in
+ * both: they are shared copy-on-write. A swapped out page gets one
+ * more user of its swap page.
+ */
+static void copy_table(unsigned long * from_page_table,
+	unsigned long * to_page_table, int nr)
+{
+	unsigned long this_page;
+
+	for ( ; nr-- > 0 ; from_page_table++,to_page_table++) {
+        //复制父进程页表
+		this_page = *from_page_table;
+		if (!(1 & this_page)) {
+			if (this_page) {
+				swap_duplicate(this_page >> 1);
+				*to_page_table = this_page;
+			}
+			continue;
+		}
+        //设置页表项属性，2是010，～2是101，代表用户、只读、存在
+		this_page &= ~2;
+        //将共享的页面设置为只读操作
+		*to_page_table = this_page;
+        //1MB以内的内核区不参与用户分页管理
+		if (this_page > LOW_MEM) {
+			*from_page_table = this_page;
+			this_page -= LOW_MEM;
+			this_page >>= 12;
+			mem_map[this_page]++; //增加引用计数，参看mem_init
+		}
+	}
+}
+
+/*
+ * Give the current task a page table of its own for the directory
+ * entry 'dir', copying a shared one, and make the entry writable.
+ * Swapped out pages stay out: the copy shares their swap pages.
+ */
+static void unshare_table(unsigned long * dir)
+{
+	unsigned long * old, * new;
+
+	old = (unsigned long *) (0xfffff000 & *dir);
+	if (mem_map[MAP_NR((unsigned long) old)] == 1) {
+		*dir |= 2;
+		invalidate();
+		return;
+	}
+	if (!(new = (unsigned long *) get_free_page()))
+		oom();
+	copy_table(old,new,1024);
+	*dir = (unsigned long) new | 7;
+	free_table((unsigned long) old);
+	invalidate();
 }
 
 /*
@@ -108,8 +478,7 @@ void free_page(unsigned long addr)
  */
 int free_page_tables(unsigned long from,unsigned long size)
 {
-	unsigned long *pg_table;
-	unsigned long * dir, nr;
+	unsigned long * dir;
 
 	if (from & 0x3fffff)
 		panic("free_page_tables called with wrong alignment");
@@ -120,14 +489,7 @@ int free_page_tables(unsigned long from,unsigned long size)
 	for ( ; size-->0 ; dir++) {
 		if (!(1 & *dir))
 			continue;
-		pg_table = (unsigned long *) (0xfffff000 & *dir);
-		for (nr=0 ; nr<1024 ; nr++) {
-			if (1 & *pg_table)
-				free_page(0xfffff000 & *pg_table);
-			*pg_table = 0;
-			pg_table++;
-		}
-		free_page(0xfffff000 & *dir);
+		free_table(0xfffff000 & *dir);
 		*dir = 0;
 	}
 	invalidate();
@@ -136,8 +498,11 @@ int free_page_tables(unsigned long from,unsigned long size)
 
 /*
  *  Well, here is one of the most complicated functions in mm. It
- * copies a range of linerar addresses by copying only the pages.
- * Let's hope this is bug-free, 'cause this one I don't want to debug :-)
+ * copies a range of linerar addresses by sharing the page tables: the
+ * child gets the same ones, read-only in both directories, and the
+ * first write to a 4MB range copies its page table (unshare_table()),
+ * and with it the pages, copy-on-write as before. A child that execs
+ * right away never copies anything.
  *
  * Note! We don't copy just any chunks of memory - addresses have to
  * be divisible by 4Mb (one page-directory entry), as this makes the
@@ -149,15 +514,13 @@ int free_page_tables(unsigned long from,unsigned long size)
  * first 160 pages - 640kB. Even that is more than we need, but it
  * doesn't take any more memory - we don't copy-on-write in the low
  * 1 Mb-range, so the pages can be shared with the kernel. Thus the
- * special case for nr=xxxx.
+ * special case for nr=xxxx. That page table is the kernel's own, so
+ * it is copied, not shared.
  */
 int copy_page_tables(unsigned long from,unsigned long to,long size)
 {
-	unsigned long * from_page_table;
 	unsigned long * to_page_table;
-	unsigned long this_page;
 	unsigned long * from_dir, * to_dir;
-	unsigned long nr;
 
     /* 0x3fffff是4 MB，是一个页表的管辖范围，二进制是22个1，
      * ||的两边必须同为0，所以，from和to后22位必须都为0，
@@ -180,29 +543,19 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 			panic("copy_page_tables: already exist");
 		if (!(1 & *from_dir))
 			continue;
-        //*from_dir是页目录项中的地址，0xfffff000＆是将低12位清零，高20位是页表的地址
-		from_page_table = (unsigned long *) (0xfffff000 & *from_dir);
+		if (from) {
+            //共享页表：两个页目录项都设为只读，页表引用计数加1
+			*from_dir &= ~2;
+			*to_dir = *from_dir;
+			mem_map[MAP_NR(0xfffff000 & *from_dir)]++;
+			continue;
+		}
 		if (!(to_page_table = (unsigned long *) get_free_page()))
 			return -1;	/* Out of memory, see freeing */
 		*to_dir = ((unsigned long) to_page_table) | 7;//7即11
-		nr = (from==0)?0xA0:1024;//0xA0即160，复制页表的项数
-		for ( ; nr-- > 0 ; from_page_table++,to_page_table++) {
-            //复制父进程页表
-			this_page = *from_page_table;
-			if (!(1 & this_page))
-				continue;
-            //设置页表项属性，2是010，～2是101，代表用户、只读、存在
-			this_page &= ~2;
-            //将共享的页面设置为只读操作
-			*to_page_table = this_page;
-            //1MB以内的内核区不参与用户分页管理
-			if (this_page > LOW_MEM) {
-				*from_page_table = this_page;
-				this_page -= LOW_MEM;
-				this_page >>= 12;
-				mem_map[this_page]++; //增加引用计数，参看mem_init
-			}
-		}
+        //*from_dir是页目录项中的地址，0xfffff000＆是将低12位清零，高20位是页表的地址
+		copy_table((unsigned long *) (0xfffff000 & *from_dir),
+			to_page_table,0xA0);	//0xA0即160，复制页表的项数
 	}
 	invalidate(); //用重置CR3为0，刷新"页变换高速缓存"
 	return 0;
@@ -245,25 +598,60 @@ unsigned long put_page(unsigned long page,unsigned long address)
 	return page;
 }
 
-void un_wp_page(unsigned long * table_entry)
+/*
+ * The same, for a page that has been written by the kernel: it must be
+ * swapped out, not just freed, as it can't be read in again.
+ */
+unsigned long put_dirty_page(unsigned long page,unsigned long address)
+{
+	unsigned long * page_table;
+
+	if (!put_page(page,address))
+		return 0;
+	page_table = (unsigned long *) (0xfffff000 &
+		*((unsigned long *) ((address>>20) & 0xffc)));
+	page_table[(address>>12) & 0x3ff] |= PAGE_DIRTY;
+	return page;
+}
+
+void un_wp_page(unsigned long * table_entry,unsigned long address)
 {
-	unsigned long old_page,new_page;
+	unsigned long old_page,new_page,from,to;
 
 	old_page = 0xfffff000 & *table_entry;
 	if (old_page >= LOW_MEM && mem_map[MAP_NR(old_page)]==1) {
 		*table_entry |= 2;
-		invalidate();
+		invalidate_page(address);
 		return;
 	}
-	if (!(new_page=get_free_page()))
+	if (!(new_page=get_user_page()))
 		oom();
-	if (old_page >= LOW_MEM)
-		mem_map[MAP_NR(old_page)]--;
-	*table_entry = new_page | 7;
-	invalidate();
-	copy_page(old_page,new_page);
+/* kmap() may sleep: copy before letting go of the old page */
+	from = kmap(old_page);
+	to = kmap(new_page);
+/* the old page may have been swapped out while we slept */
+	if ((*table_entry & 0xfffff001) != (old_page | 1)) {
+		kunmap(to);
+		kunmap(from);
+		free_page(new_page);
+		return;
+	}
+	copy_page(from,to);
+	kunmap(to);
+	kunmap(from);
+	free_page(old_page);
+	*table_entry = new_page | PAGE_DIRTY | 7;
+	invalidate_page(address);
 }	
 
+/* a write to an mmap()ed area without PROT_WRITE is a segment error */
+static int writable(unsigned long address)
+{
+	struct vm_area * v = find_vma(current,address-current->start_code);
+
+	return !v || (v->prot & PROT_WRITE);
+}
+
 /*
  * This routine handles present pages, when users try to write
  * to a shared page. It is done by copying the page to a new address
@@ -279,22 +667,41 @@ void do_wp_page(unsigned long error_code,unsigned long address)
 	if (CODE_SPACE(address))
 		do_exit(SIGSEGV);
 #endif
-	un_wp_page((unsigned long *)
-		(((address>>10) & 0xffc) + (0xfffff000 &
-		*((unsigned long *) ((address>>20) &0xffc)))));
+	unsigned long * dir, * page;
 
+	if (!writable(address))
+		do_exit(SIGSEGV);
+	dir = (unsigned long *) ((address>>20) & 0xffc);
+	if (!(2 & *dir))
+		unshare_table(dir);
+	page = (unsigned long *) (((address>>10) & 0xffc) +
+		(0xfffff000 & *dir));
+/* it may have been the page table only, or swapped out meanwhile */
+	if ((3 & *page) == 1)
+		un_wp_page(page,address);
 }
 
 void write_verify(unsigned long address)
 {
 	unsigned long page;
 
-	if (!( (page = *((unsigned long *) ((address>>20) & 0xffc)) )&1))
+	unsigned long * dir = (unsigned long *) ((address>>20) & 0xffc);
+
+	if (!((page = *dir) & 1))
 		return;
+	if (!(page & 2)) {	/* shared page table */
+		if (!writable(address))
+			do_exit(SIGSEGV);
+		unshare_table(dir);
+		page = *dir;
+	}
 	page &= 0xfffff000;
 	page += ((address>>10) & 0xffc);
-	if ((3 & *(unsigned long *) page) == 1)  /* non-writeable, present */
-		un_wp_page((unsigned long *) page);
+	if ((3 & *(unsigned long *) page) == 1) {  /* non-writeable, present */
+		if (!writable(address))
+			do_exit(SIGSEGV);
+		un_wp_page((unsigned long *) page,address);
+	}
 	return;
 }
 
@@ -302,21 +709,27 @@ void get_empty_page(unsigned long address)
 {
 	unsigned long tmp;
 
-	if (!(tmp=get_free_page()) || !put_page(tmp,address)) {
-		free_page(tmp);		/* 0 is ok - ignored */
+/* a page cleared while idle, unless memory is so low we should swap */
+	if (nr_free_pages < FREE_RESERVE || !(tmp=get_zero_page())) {
+		if (!(tmp=get_user_page()))
+			oom();
+		clear_user_page(tmp);
+	}
+	if (!put_page(tmp,address)) {
+		free_page(tmp);
 		oom();
 	}
 }
 
 /*
- * try_to_share() checks the page at address "address" in the task "p",
- * to see if it exists, and if it is clean. If so, share it with the current
- * task.
+ * try_to_share() checks the page at linear address "from", to see if
+ * it exists, and if it is clean. If so, share it at linear address "to"
+ * in the current task.
  *
- * NOTE! This assumes we have checked that p != current, and that they
- * share the same executable.
+ * NOTE! This assumes we have checked that both belong to different
+ * tasks, and that they map the same part of the same file.
  */
-static int try_to_share(unsigned long address, struct task_struct * p)
+static int try_to_share(unsigned long from_addr, unsigned long to_addr)
 {
 	unsigned long from;
 	unsigned long to;
@@ -324,15 +737,14 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 	unsigned long to_page;
 	unsigned long phys_addr;
 
-	from_page = to_page = ((address>>20) & 0xffc);
-	from_page += ((p->start_code>>20) & 0xffc);
-	to_page += ((current->start_code>>20) & 0xffc);
+	from_page = ((from_addr>>20) & 0xffc);
+	to_page = ((to_addr>>20) & 0xffc);
 /* is there a page-directory at from? */
 	from = *(unsigned long *) from_page;
 	if (!(from & 1))
 		return 0;
 	from &= 0xfffff000;
-	from_page = from + ((address>>10) & 0xffc);
+	from_page = from + ((from_addr>>10) & 0xffc);
 	phys_addr = *(unsigned long *) from_page;
 /* is the page clean and present? */
 	if ((phys_addr & 0x41) != 0x01)
@@ -348,13 +760,13 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 			oom();
 	}
 	to &= 0xfffff000;
-	to_page = to + ((address>>10) & 0xffc);
+	to_page = to + ((to_addr>>10) & 0xffc);
 	if (1 & *(unsigned long *) to_page)
 		panic("try_to_share: to_page already exists");
 /* share them: write-protect */
 	*(unsigned long *) from_page &= ~2;
 	*(unsigned long *) to_page = *(unsigned long *) from_page;
-	invalidate();
+	invalidate_page(from_addr);
 	phys_addr -= LOW_MEM;
 	phys_addr >>= 12;
 	mem_map[phys_addr]++;
@@ -384,82 +796,360 @@ static int share_page(unsigned long address)
 			continue;
 		if ((*p)->executable != current->executable)
 			continue;
-		if (try_to_share(address,*p))
+		if (try_to_share((*p)->start_code+address,
+		    current->start_code+address))
 			return 1;
 	}
 	return 0;
 }
 
-void do_no_page(unsigned long error_code,unsigned long address)
+/*
+ * Same for a page of an mmap()ed file: look for another task that maps
+ * the same file page. 'address' is in the data space of current.
+ */
+static int share_vma_page(struct vm_area * v, unsigned long address)
 {
+	struct task_struct ** p;
+	struct vm_area * w;
+	unsigned long off = v->offset + address - v->start;
+
+	if (v->inode->i_count < 2)
+		return 0;
+	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
+		if (!*p || current == *p)
+			continue;
+		for (w = (*p)->vma ; w < (*p)->vma+NR_VMA ; w++) {
+			if (!w->end || w->inode != v->inode)
+				continue;
+			if (off < w->offset || off >= w->offset+w->end-w->start)
+				continue;
+			if (try_to_share((*p)->start_code+w->start+off-w->offset,
+			    current->start_code+address))
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/* write-protect the (present) page at linear address 'address' */
+static void wp_page(unsigned long address)
+{
+	unsigned long * page_table;
+
+	page_table = (unsigned long *) (0xfffff000 &
+		*((unsigned long *) ((address>>20) & 0xffc)));
+	page_table[(address>>12) & 0x3ff] &= ~2;
+	invalidate_page(address);
+}
+
+/*
+ * Fault in a page of an mmap()ed area: zeroes for anonymous memory, or
+ * the file contents, with the part past the end of the file cleared.
+ */
+static void do_vma_page(struct vm_area * v, unsigned long address)
+{
+	unsigned long tmp = address - current->start_code;
+	unsigned long off = v->offset + tmp - v->start;
+	unsigned long page,addr;
 	int nr[4];
-	unsigned long tmp;
-	unsigned long page;
 	int block,i;
 
-	address &= 0xfffff000;
-	tmp = address - current->start_code;
-    //如果不是加载程序而是其他原因导致缺页
-	if (!current->executable || tmp >= current->end_data) {
-		get_empty_page(address); //比如说压栈没有地方了，那么直接申请页面就可以了
-		return;
+	if (!v->inode)
+		get_empty_page(address);
+	else if (!share_vma_page(v,tmp)) {
+		if (!(page = get_user_page()))
+			oom();
+		block = off/BLOCK_SIZE;
+		for (i=0 ; i<4 ; block++,i++)
+			nr[i] = block*BLOCK_SIZE < v->inode->i_size ?
+				bmap(v->inode,block) : 0;
+		addr = kmap(page);
+		bread_page(addr,v->inode->i_dev,nr);
+		if (off + 4096 > v->inode->i_size) {
+			i = off < v->inode->i_size ? v->inode->i_size - off : 0;
+			for ( ; i < 4096 ; i++)
+				*(char *) (addr+i) = 0;
+		}
+		kunmap(addr);
+		if (!put_page(page,address)) {
+			free_page(page);
+			oom();
+		}
 	}
-    //尝试能不能和其他进程共享程序，这样就不需要加载了，
-	if (share_page(tmp))
-		return;
+	if (!(v->prot & PROT_WRITE))
+		wp_page(address);
+}
+
+/*
+ * Unmap and free the pages in a page aligned range of linear addresses,
+ * as munmap() needs. The page tables are left, exit() frees those.
+ */
+void unmap_page_range(unsigned long from,unsigned long size)
+{
+	unsigned long * dir, * pg_table;
+	int flush_all = !has_invlpg || size > INVLPG_MAX*4096;
+
+	for ( ; size ; from += 4096, size -= 4096) {
+		dir = (unsigned long *) ((from>>20) & 0xffc);
+		if (!(1 & *dir))
+			continue;
+		if (!(2 & *dir))
+			unshare_table(dir);
+		pg_table = (unsigned long *) (0xfffff000 & *dir) +
+			((from>>12) & 0x3ff);
+		if (1 & *pg_table)
+			free_page(0xfffff000 & *pg_table);
+		else if (*pg_table)
+			swap_free(*pg_table >> 1);
+		*pg_table = 0;
+		if (!flush_all)
+			invalidate_page(from);
+	}
+	if (flush_all)
+		invalidate();
+}
+
+/* the blocks of the executable for the page at 'tmp' in the data space */
+static void exec_blocks(unsigned long tmp, int nr[4])
+{
+	int block,i;
 
-    //为shell程序申请一页新的内存
-	if (!(page = get_free_page()))
-		oom();
 /* remember that 1 block is used for header */
 	block = 1 + tmp/BLOCK_SIZE;
 	for (i=0 ; i<4 ; block++,i++)
 		nr[i] = bmap(current->executable,block);
+}
+
+/* read them into the new page 'page' */
+static void read_exec_page(unsigned long tmp, unsigned long page, int nr[4])
+{
+	unsigned long addr;
+	int i;
 
     //读取4个逻辑块（1页）的shell程序内容进内存页面
     //在增加了一页内存后，该页内存的部分可以能会超过进程的end_data位置
-	bread_page(page,current->executable->i_dev,nr);
+    //高端内存的页要先映射到kmap窗口里才能访问
+	addr = kmap(page);
+	bread_page(addr,current->executable->i_dev,nr);
 
     //对物理也超出部分进行处理（对齐）
 	i = tmp + 4096 - current->end_data;
-	tmp = page + 4096;
+	tmp = addr + 4096;
 	while (i-- > 0) {
 		tmp--;
 		*(char *)tmp = 0;
 	}
+	kunmap(addr);
+}
 
-    //将物理地址映射到线性地址空间
-	if (put_page(page,address))
+/*
+ * Fault-around: after a fault in the executable, the next FAULT_AROUND
+ * pages are mapped too if another task has them or their blocks are in
+ * the buffer cache, and reading is started for those that aren't, so
+ * the next fault finds them there. Starting a program then doesn't
+ * take a fault and a wait for every page. This stays in the page table
+ * of the fault, which do_no_page() has made ours, and is not done when
+ * memory is low.
+ */
+#define FAULT_AROUND 8
+
+static void fault_around(unsigned long address)
+{
+	unsigned long * pg_table;
+	unsigned long tmp,page;
+	int nr[4];
+	int n;
+
+	pg_table = (unsigned long *) (0xfffff000 &
+		*((unsigned long *) ((address>>20) & 0xffc)));
+	for (n=0 ; n<FAULT_AROUND ; n++) {
+		address += 4096;
+		if (!(address & 0x3fffff))
+			return;
+		tmp = address - current->start_code;
+		if (tmp >= current->end_data)
+			return;
+		if (pg_table[(address>>12) & 0x3ff])
+			continue;
+		if (share_page(tmp))
+			continue;
+		exec_blocks(tmp,nr);
+		if (!page_in_cache(current->executable->i_dev,nr)) {
+			breada_page(current->executable->i_dev,nr);
+			continue;
+		}
+		if (nr_free_pages < FREE_RESERVE || !(page = get_user_page()))
+			return;
+		read_exec_page(tmp,page,nr);
+		if (!put_page(page,address)) {
+			free_page(page);
+			return;
+		}
+	}
+}
+
+void do_no_page(unsigned long error_code,unsigned long address)
+{
+	int nr[4];
+	unsigned long tmp;
+	unsigned long page;
+	struct vm_area * v;
+
+	address &= 0xfffff000;
+	page = *(unsigned long *) ((address>>20) & 0xffc);
+	if ((page & 3) == 1) {	/* shared page table */
+		unshare_table((unsigned long *) ((address>>20) & 0xffc));
+		page = *(unsigned long *) ((address>>20) & 0xffc);
+	}
+	if (page & 1) {
+		page = (0xfffff000 & page) + ((address>>10) & 0xffc);
+		if (*(unsigned long *) page && !(1 & *(unsigned long *) page)) {
+			swap_in((unsigned long *) page);
+			return;
+		}
+	}
+	tmp = address - current->start_code;
+	if ((v = find_vma(current,tmp))) {
+		do_vma_page(v,address);
+		return;
+	}
+    //如果不是加载程序而是其他原因导致缺页
+	if (!current->executable || tmp >= current->end_data) {
+		get_empty_page(address); //比如说压栈没有地方了，那么直接申请页面就可以了
 		return;
+	}
+    //尝试能不能和其他进程共享程序，这样就不需要加载了，
+	if (share_page(tmp)) {
+		fault_around(address);
+		return;
+	}
 
-	free_page(page);
-	oom();
+    //为shell程序申请一页新的内存，bread_page()会写满整页，不必清零
+	if (!(page = get_user_page()))
+		oom();
+	exec_blocks(tmp,nr);
+	read_exec_page(tmp,page,nr);
+
+    //将物理地址映射到线性地址空间
+	if (!put_page(page,address)) {
+		free_page(page);
+		oom();
+	}
+	fault_around(address);
+}
+
+/*
+ * Can 'flag' in eflags be changed? The AC flag (0x40000) can on a 486
+ * and later, which have invlpg, and the ID flag (0x200000) can if there
+ * is a cpuid instruction.
+ */
+static int eflags_free(unsigned long flag)
+{
+	unsigned long a,b;
+
+	__asm__("pushfl\n\t"
+		"pushfl\n\t"
+		"popl %0\n\t"
+		"movl %0,%1\n\t"
+		"xorl %2,%0\n\t"
+		"pushl %0\n\t"
+		"popfl\n\t"
+		"pushfl\n\t"
+		"popl %0\n\t"
+		"popfl"
+		:"=&r" (a),"=&r" (b):"ir" (flag));
+	return ((a ^ b) & flag) != 0;
+}
+
+/* 4MB pages: cpuid function 1 says so in bit 3 of edx */
+static int cpu_has_pse(void)
+{
+	unsigned long a,d;
+
+	if (!eflags_free(0x200000))
+		return 0;
+	__asm__("cpuid":"=a" (a),"=d" (d):"0" (1):"bx","cx");
+	return (d >> 3) & 1;
 }
 
+/*
+ * The direct map above 4MB, where the page frames are, uses 4MB pages
+ * if the cpu has them, instead of head.s's page tables: fewer tlb
+ * entries, and no page tables to allocate. The first 4MB keep theirs:
+ * task 0 runs there, its page table is copied for task 1, and the
+ * video memory and bios are there.
+ */
+static void map_direct(unsigned long from, unsigned long to)
+{
+	__asm__("movl %%cr4,%%eax\n\t"
+		"orl $0x10,%%eax\n\t"
+		"movl %%eax,%%cr4"
+		:::"ax");
+	for ( ; from < to ; from += 0x400000)
+		pg_dir[from>>22] = from | 0x87;
+}
+
+/*
+ * head.s has mapped the first 16MB. The page tables for the rest of
+ * the direct map (unless it uses 4MB pages), the kmap() page table,
+ * mem_map[] and the stack of free high pages are taken from the start
+ * of main memory, which is well below 16MB.
+ */
 void mem_init(long start_mem, long end_mem)
 {
+	unsigned long * pg_table;
+	long addr;
 	int i;
 
+	has_invlpg = eflags_free(0x40000);
 	HIGH_MEMORY = end_mem;
-	for (i=0 ; i<PAGING_PAGES ; i++)
+	DIRECT_END = end_mem < DIRECT_MEM ? end_mem : DIRECT_MEM;
+	if (cpu_has_pse())
+		map_direct(4*1024*1024,DIRECT_END);
+	else
+		for (addr = 16*1024*1024 ; addr < DIRECT_END ; ) {
+			pg_table = (unsigned long *) start_mem;
+			start_mem += 4096;
+			pg_dir[addr>>22] = (unsigned long) pg_table | 7;
+			for (i=0 ; i<1024 ; i++,addr += 4096)
+				pg_table[i] = addr < DIRECT_END ? addr | 7 : 0;
+		}
+	kmap_table = (unsigned long *) start_mem;
+	start_mem += 4096;
+	for (i=0 ; i<1024 ; i++)
+		kmap_table[i] = 0;
+	pg_dir[KMAP_BASE>>22] = (unsigned long) kmap_table | 7;
+	invalidate();
+	paging_pages = (end_mem - LOW_MEM) >> 12;
+	mem_map = (unsigned char *) start_mem;
+	start_mem += paging_pages;
+	high_free = (unsigned long *) start_mem;
+	start_mem += ((end_mem - DIRECT_END) >> 12) * sizeof (long);
+	start_mem = (start_mem + 4095) & ~4095;
+	for (i=0 ; i<paging_pages ; i++)
 		mem_map[i] = USED;
-	i = MAP_NR(start_mem);
-	end_mem -= start_mem;
-	end_mem >>= 12;
-	while (end_mem-->0)
-		mem_map[i++]=0;
+	for (addr = start_mem ; addr < DIRECT_END ; addr += 4096) {
+		mem_map[MAP_NR(addr)] = 0;
+		*(unsigned long *) addr = free_list;
+		free_list = addr;
+		nr_free_pages++;
+	}
+	for (addr = end_mem ; addr > DIRECT_END ; ) {
+		addr -= 4096;
+		mem_map[MAP_NR(addr)] = 0;
+		high_free[nr_high_free++] = addr;
+		nr_free_pages++;
+	}
 }
 
 void calc_mem(void)
 {
-	int i,j,k,free=0;
+	int i,j,k;
 	long * pg_tbl;
 
-	for(i=0 ; i<PAGING_PAGES ; i++)
-		if (!mem_map[i]) free++;
-	printk("%d pages free (of %d)\n\r",free,PAGING_PAGES);
+	printk("%d pages free (of %d)\n\r",nr_free_pages,paging_pages);
 	for(i=2 ; i<1024 ; i++) {
-		if (1&pg_dir[i]) {
+		if ((0x81 & pg_dir[i]) == 1) {
 			pg_tbl=(long *) (0xfffff000 & pg_dir[i]);
 			for(j=k=0 ; j<1024 ; j++)
 				if (pg_tbl[j]&1)
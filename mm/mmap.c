@@ -0,0 +1,208 @@
+/*
+ *  linux/mm/mmap.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * mmap() and munmap(). A task has up to NR_VMA mapped areas in
+ * current->vma[], placed between the heap and MMAP_TOP. Nothing is read
+ * by mmap() itself: do_no_page() finds the area and fills the page in,
+ * from the file through bread_page() or with zeroes, and shares clean
+ * file pages with other tasks mapping the same part of the file, as it
+ * does for executables.
+ *
+ * Private writable mappings get copy-on-write through do_wp_page() as
+ * usual; read-only ones are mapped without the write bit, and writing
+ * to them kills the task. Shared mappings must be read-only, as nothing
+ * is ever written back to the file.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+
+#define TASK_SIZE 0x4000000
+#define MMAP_TOP (TASK_SIZE-0x800000)	/* leaves 8MB for the stack */
+
+struct vm_area * find_vma(struct task_struct * p, unsigned long addr)
+{
+	struct vm_area * v;
+
+	for (v = p->vma ; v < p->vma+NR_VMA ; v++)
+		if (v->end && addr >= v->start && addr < v->end)
+			return v;
+	return NULL;
+}
+
+/* a mapping of the current task in start..end, if any */
+struct vm_area * vma_overlap(unsigned long start, unsigned long end)
+{
+	struct vm_area * v;
+
+	for (v = current->vma ; v < current->vma+NR_VMA ; v++)
+		if (v->end && start < v->end && end > v->start)
+			return v;
+	return NULL;
+}
+
+/* highest free range of 'len' bytes below MMAP_TOP, 0 if none */
+static unsigned long get_unmapped_area(unsigned long len)
+{
+	unsigned long end = MMAP_TOP;
+	struct vm_area * v;
+
+	while (end >= len && end-len >= PAGE_ALIGN(current->brk)) {
+		if (!(v = vma_overlap(end-len,end)))
+			return end-len;
+		end = v->start;
+	}
+	return 0;
+}
+
+static void unmap(unsigned long start, unsigned long end)
+{
+	unmap_page_range(current->start_code+start,end-start);
+}
+
+static int do_munmap(unsigned long start, unsigned long end)
+{
+	struct vm_area * v, * n;
+
+	for (n = current->vma ; n < current->vma+NR_VMA ; n++)
+		if (!n->end)
+			break;
+	for (v = current->vma ; v < current->vma+NR_VMA ; v++) {
+		if (!v->end || start >= v->end || end <= v->start)
+			continue;
+		if (start > v->start && end < v->end) {	/* split in two */
+			if (n >= current->vma+NR_VMA)
+				return -ENOMEM;
+			*n = *v;
+			n->start = end;
+			n->offset += end - v->start;
+			if (n->inode)
+				n->inode->i_count++;
+			unmap(start,end);
+			v->end = start;
+			return 0;
+		}
+		if (start > v->start) {
+			unmap(start,v->end);
+			v->end = start;
+		} else if (end < v->end) {
+			unmap(v->start,end);
+			v->offset += end - v->start;
+			v->start = end;
+		} else {
+			unmap(v->start,v->end);
+			iput(v->inode);
+			v->inode = NULL;
+			v->end = 0;
+		}
+	}
+	return 0;
+}
+
+/* is there a free slot for start..end once what is there is unmapped? */
+static int vma_room(unsigned long start, unsigned long end)
+{
+	struct vm_area * v;
+	int room = 0;
+
+	for (v = current->vma ; v < current->vma+NR_VMA ; v++)
+		if (!v->end || (start <= v->start && end >= v->end))
+			room++;
+		else if (start > v->start && end < v->end)
+			room--;		/* split in two */
+	return room > 0;
+}
+
+/* called by exit() and exec(), which free the pages themselves */
+void exit_mmap(void)
+{
+	struct vm_area * v;
+
+	for (v = current->vma ; v < current->vma+NR_VMA ; v++)
+		if (v->end) {
+			iput(v->inode);
+			v->inode = NULL;
+			v->end = 0;
+		}
+}
+
+int sys_mmap(unsigned long * buffer)
+{
+	unsigned long addr,len,off;
+	int prot,flags,fd,error;
+	struct m_inode * inode = NULL;
+	struct file * file;
+	struct vm_area * v;
+
+	addr = get_fs_long(buffer);
+	len = PAGE_ALIGN(get_fs_long(buffer+1));
+	prot = get_fs_long(buffer+2);
+	flags = get_fs_long(buffer+3);
+	fd = get_fs_long(buffer+4);
+	off = get_fs_long(buffer+5);
+	if (!len || len > MMAP_TOP || (off & 4095) || !(prot & PROT_READ))
+		return -EINVAL;
+	switch (flags & (MAP_SHARED|MAP_PRIVATE)) {
+		case MAP_SHARED:
+			if ((prot & PROT_WRITE) || (flags & MAP_ANONYMOUS))
+				return -EINVAL;
+			break;
+		case MAP_PRIVATE:
+			break;
+		default:
+			return -EINVAL;
+	}
+	if (!(flags & MAP_ANONYMOUS)) {
+		if (fd >= current->max_fds || fd < 0 || !(file=current->filp[fd]))
+			return -EBADF;
+		if (!S_ISREG(file->f_inode->i_mode))
+			return -ENODEV;
+		if ((file->f_flags & O_ACCMODE) == O_WRONLY)
+			return -EACCES;
+		if (off+len < off)
+			return -EINVAL;
+		inode = file->f_inode;
+	}
+	if (flags & MAP_FIXED) {
+		if ((addr & 4095) || addr < PAGE_ALIGN(current->brk) ||
+		    addr+len > MMAP_TOP || addr+len < addr)
+			return -EINVAL;
+		if (!vma_room(addr,addr+len))
+			return -ENOMEM;
+		if ((error = do_munmap(addr,addr+len)))
+			return error;
+	} else if (!(addr = get_unmapped_area(len)))
+		return -ENOMEM;
+	for (v = current->vma ; v < current->vma+NR_VMA ; v++)
+		if (!v->end)
+			break;
+	if (v >= current->vma+NR_VMA)
+		return -ENOMEM;
+/* brk() leaves the pages of a shrunk heap mapped, they must not show */
+	unmap(addr,addr+len);
+	v->start = addr;
+	v->end = addr+len;
+	if ((v->inode = inode))
+		inode->i_count++;
+	v->offset = off;
+	v->prot = prot;
+	v->flags = flags;
+	return addr;
+}
+
+int sys_munmap(unsigned long addr, unsigned long len)
+{
+	if ((addr & 4095) || !len || addr+len < addr)
+		return -EINVAL;
+	return do_munmap(addr,addr+PAGE_ALIGN(len));
+}
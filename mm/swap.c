@@ -0,0 +1,169 @@
+/*
+ *  linux/mm/swap.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * This file handles the swap device: the map of free swap pages and
+ * the reading and writing of pages. Which pages go out, and how they
+ * come back in, is up to memory.c.
+ *
+ * The first page of the swap device is a map of the usable pages, one
+ * bit per page, ending with the signature "SWAP-SPACE" (the old mkswap
+ * format). swapon() turns it into a use count for each page, so that
+ * copies of a page table can share the swapped out entries: 0 is a
+ * free page, SWAP_UNUSED one that isn't there or is bad. Page 0 is
+ * never used, so a swap page number is never zero.
+ */
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+
+#define SWAP_BITS ((PAGE_SIZE-10)<<3)	/* the signature ends the map */
+#define SWAP_MAP_PAGES ((SWAP_BITS+PAGE_SIZE-1)/PAGE_SIZE)
+#define SWAP_UNUSED 255
+
+static int swap_dev = 0;
+static unsigned char * swap_map[SWAP_MAP_PAGES];
+static int swap_hint = 0;	/* no free swap page below this */
+
+#define swap_count(nr) (swap_map[(nr)/PAGE_SIZE][(nr)%PAGE_SIZE])
+
+/* get a free swap page, 0 if there is none */
+int get_swap_page(void)
+{
+	int nr;
+
+	if (!swap_map[0])
+		return 0;
+	for (nr = swap_hint ; nr < SWAP_BITS ; nr++)
+		if (!swap_count(nr)) {
+			swap_count(nr) = 1;
+			swap_hint = nr+1;
+			return nr;
+		}
+	swap_hint = SWAP_BITS;
+	return 0;
+}
+
+static int bad_swap_page(int nr)
+{
+	if (!swap_map[0] || nr < 1 || nr >= SWAP_BITS ||
+	    swap_count(nr) == SWAP_UNUSED) {
+		printk("nonexistent swap-page %d\n\r",nr);
+		return 1;
+	}
+	if (!swap_count(nr)) {
+		printk("swap-page %d is free\n\r",nr);
+		return 1;
+	}
+	return 0;
+}
+
+/* one more page table entry holds swap page 'nr' */
+void swap_duplicate(int nr)
+{
+	if (bad_swap_page(nr))
+		return;
+	if (swap_count(nr) >= SWAP_UNUSED-1)
+		panic("swap_duplicate: too many users");
+	swap_count(nr)++;
+}
+
+/* one page table entry less holds swap page 'nr' */
+void swap_free(int nr)
+{
+	if (bad_swap_page(nr))
+		return;
+	if (!--swap_count(nr) && nr < swap_hint)
+		swap_hint = nr;
+}
+
+static int bad_signature(char * p)
+{
+	char * sig = "SWAP-SPACE";
+
+	while (*sig)
+		if (*p++ != *sig++)
+			return 1;
+	return 0;
+}
+
+/* read or write swap page 'nr' to or from the physical page 'page' */
+void swap_page(int rw, int nr, unsigned long page)
+{
+	unsigned long addr;
+
+	if (!swap_dev)
+		panic("swap_page: no swap device");
+	addr = kmap(page);
+	ll_rw_page(rw,swap_dev,nr,(char *) addr);
+	kunmap(addr);
+}
+
+/*
+ * Start swapping to a block device. Only one swap device can be used,
+ * and it can't be turned off again. The floppy driver only does one
+ * block per request, so floppies can't be used for swapping.
+ */
+int sys_swapon(const char * specialfile)
+{
+	struct m_inode * inode;
+	unsigned long * map;
+	unsigned char * count[SWAP_MAP_PAGES];
+	int dev,i,j;
+
+	if (!suser())
+		return -EPERM;
+	if (!(inode = namei(specialfile)))
+		return -ENOENT;
+	dev = inode->i_zone[0];
+	i = S_ISBLK(inode->i_mode);
+	iput(inode);
+	if (!i)
+		return -ENOTBLK;
+	if (MAJOR(dev) != 1 && MAJOR(dev) != 3)
+		return -EINVAL;
+	if (swap_dev || swap_map[0])
+		return -EBUSY;
+	if (!(map = (unsigned long *) get_free_page()))
+		return -ENOMEM;
+	swap_dev = dev;
+	ll_rw_page(READ,dev,0,(char *) map);
+	for (i = 0 ; i < SWAP_MAP_PAGES ; i++)
+		count[i] = NULL;
+	j = -EINVAL;
+	if (bad_signature((char *) map + SWAP_BITS/8) || (map[0] & 1))
+		goto out;
+	for (i = 0 ; i < SWAP_MAP_PAGES ; i++)
+		if (!(count[i] = (unsigned char *) get_free_page())) {
+			j = -ENOMEM;
+			goto out;
+		}
+	for (i = j = 0 ; i < SWAP_MAP_PAGES*PAGE_SIZE ; i++)
+		if (i < SWAP_BITS && (map[i>>5] & (1 << (i & 31))))
+			j++;
+		else
+			count[i/PAGE_SIZE][i%PAGE_SIZE] = SWAP_UNUSED;
+	if (!j) {
+		j = -EINVAL;
+		goto out;
+	}
+	free_page((unsigned long) map);
+	for (i = 0 ; i < SWAP_MAP_PAGES ; i++)
+		swap_map[i] = count[i];
+	swap_hint = 1;
+	printk("Adding swap: %d pages (%dkB) of swap-space\n\r",j,j*4);
+	return 0;
+out:
+	for (i = 0 ; i < SWAP_MAP_PAGES && count[i] ; i++)
+		free_page((unsigned long) count[i]);
+	swap_dev = 0;
+	free_page((unsigned long) map);
+	return j;
+}
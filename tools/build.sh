@@ -10,8 +10,9 @@ IMAGE=$4
 root_dev=$5
 
 # Set the biggest sys_size
-# Changes from 0x20000 to 0x30000 by tigercn to avoid oversized code.
-SYS_SIZE=$((0x3000*16))
+# Changes from 0x20000 to 0x30000 by tigercn to avoid oversized code,
+# then to 0x40000 for the kmem caches. Must match SYSSIZE in bootsect.s.
+SYS_SIZE=$((0x4000*16))
 
 # set the default "device" file for root image file
 if [ -z "$root_dev" ]; then
@@ -0,0 +1,18 @@
+/*
+ * crt0.s - entry point of the fs harness. No C library: pick argc and
+ * argv off the initial stack, run main() and hand its result to exit.
+ */
+
+.globl _start
+
+_start:
+	xorl %ebp,%ebp
+	movl (%esp),%eax	# argc
+	leal 4(%esp),%edx	# argv
+	andl $0xfffffff0,%esp
+	subl $8,%esp
+	pushl %edx
+	pushl %eax
+	call main
+	pushl %eax
+	call h_exit
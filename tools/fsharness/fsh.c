@@ -0,0 +1,550 @@
+/*
+ *  tools/fsharness/fsh.c
+ *
+ * Benchmark and stress driver for the filesystem layer. It mounts a
+ * Minix image as the root device and calls the sys_xxx() entry points
+ * directly, the way system_call would.
+ *
+ *	fsh [-b bufkb] image bench [nfiles] [filekb]
+ *	fsh [-b bufkb] image stress [ops] [seed]
+ *	fsh [-b bufkb] image verify
+ *	fsh [-b bufkb] image mkjournal [kb]
+ *	fsh [-b bufkb] image crash [ops] [seed]
+ *	fsh [-b bufkb] image mount
+ *
+ * mkjournal makes /.journal, used from the next mount on. crash is
+ * stress with a sync every 100 operations, that stops dead at the end:
+ * mounting the image again replays the journal, and fsck should find
+ * it clean. mount does nothing but mount and sync.
+ *
+ * With -t, /bench and /stress are tmpfs mounts (minors 0 and 1) that
+ * are unmounted again at the end.
+ *
+ * Every phase reports operations per second and the number of blocks
+ * read from and written to the image.
+ */
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+#include "host.h"
+
+extern int sys_open(const char * filename,int flag,int mode);
+extern int sys_close(unsigned int fd);
+extern int sys_read(unsigned int fd,char * buf,int count);
+extern int sys_write(unsigned int fd,char * buf,int count);
+extern int sys_lseek(unsigned int fd,off_t offset,int origin);
+extern int sys_unlink(const char * name);
+extern int sys_mkdir(const char * pathname,int mode);
+extern int sys_stat(char * filename, struct stat * statbuf);
+extern int sys_sync(void);
+extern int sys_sendfile(unsigned long * buffer);
+extern int sys_mknod(const char * filename, int mode, int dev);
+extern int sys_mount(char * dev_name, char * dir_name, int flags);
+extern int sys_umount(char * dev_name);
+extern int sys_getdents(unsigned int fd, struct dirent * dirp,
+	unsigned int count);
+
+static char iobuf[8192];
+
+static int atoi(const char * s)
+{
+	int i = 0;
+
+	while (*s >= '0' && *s <= '9')
+		i = i*10 + *s++ - '0';
+	return i;
+}
+
+static int streq(const char * a, const char * b)
+{
+	while (*a && *a == *b)
+		a++, b++;
+	return *a == *b;
+}
+
+static char * fmt_name(char * buf, const char * dir, int n)
+{
+	char * p = buf;
+	char tmp[12];
+	int i = 0;
+
+	while ((*p = *dir++))
+		p++;
+	*p++ = '/';
+	*p++ = 'f';
+	do {
+		tmp[i++] = '0' + n%10;
+		n /= 10;
+	} while (n);
+	while (i)
+		*p++ = tmp[--i];
+	*p = 0;
+	return buf;
+}
+
+/* contents of file n at offset off: any write history gives the same bytes */
+static inline char pattern(int n, unsigned long off)
+{
+	return (char) (n*7 + off*13 + (off>>10));
+}
+
+static void fill(char * buf, int n, unsigned long off, int count)
+{
+	while (count-- > 0)
+		*buf++ = pattern(n,off++);
+}
+
+static int check(char * buf, int n, unsigned long off, int count)
+{
+	while (count-- > 0)
+		if (*buf++ != pattern(n,off++))
+			return 0;
+	return 1;
+}
+
+static unsigned long seed = 1;
+
+static unsigned long rnd(unsigned long range)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((seed>>8) & 0xffffff) % range;
+}
+
+/* ---- timing ---- */
+
+static unsigned long long t0;
+static unsigned long r0, w0;
+
+static void phase_start(void)
+{
+	r0 = nr_block_reads;
+	w0 = nr_block_writes;
+	t0 = h_usecs();
+}
+
+static void phase_end(const char * name, int ops)
+{
+	unsigned long us = h_usecs() - t0;
+
+	if (!us)
+		us = 1;
+	h_printf("%-10s %7d ops %8d us %9d ops/s %7d reads %7d writes\n",
+		name, ops, us, (int) (ops*1000000.0/us),
+		nr_block_reads-r0, nr_block_writes-w0);
+}
+
+/* ---- directories ---- */
+
+/* live entries of 'dir', read as raw dir_entry slots */
+static int list_raw(const char * dir)
+{
+	struct dir_entry de;
+	int fd,n = 0;
+
+	if ((fd = sys_open(dir,O_RDONLY,0)) < 0)
+		panic("cannot open directory");
+	while (sys_read(fd,(char *) &de,sizeof(de)) == sizeof(de))
+		if (de.inode)
+			n++;
+	sys_close(fd);
+	return n;
+}
+
+/* entries of 'dir' through getdents(), calling fn() for each name */
+static int list_dents(const char * dir, void (*fn)(char * name))
+{
+	static char dbuf[1024];
+	struct dirent * d;
+	int fd,k,i,n = 0;
+
+	if ((fd = sys_open(dir,O_RDONLY,0)) < 0)
+		panic("cannot open directory");
+	while ((k = sys_getdents(fd,(struct dirent *) dbuf,sizeof(dbuf))) > 0)
+		for (i=0 ; i<k ; i += d->d_reclen, n++) {
+			d = (struct dirent *) (dbuf+i);
+			if (fn)
+				fn(d->d_name);
+		}
+	if (k < 0)
+		panic("getdents failed");
+	sys_close(fd);
+	return n;
+}
+
+/* ---- bench ---- */
+
+#define NR_FDS 600
+
+static int fds[NR_FDS];
+
+static void bench(int nfiles, int filekb)
+{
+	char name[64];
+	struct stat st;
+	unsigned long args[4];
+	int i,fd,fd2,k;
+
+	sys_mkdir("/bench",0755);
+
+	phase_start();
+	for (i=0 ; i<nfiles ; i++) {
+		if ((fd = sys_open(fmt_name(name,"/bench",i),
+		    O_CREAT|O_TRUNC|O_WRONLY,0644)) < 0)
+			panic("bench: create failed");
+		sys_close(fd);
+	}
+	phase_end("create",nfiles);
+
+	phase_start();
+	for (k=0 ; k<4 ; k++)
+		for (i=nfiles ; i-- > 0 ; )
+			if (sys_stat(fmt_name(name,"/bench",i),&st))
+				panic("bench: lookup failed");
+	phase_end("lookup",4*nfiles);
+
+	phase_start();
+	if ((fd = sys_open("/bench/big",O_CREAT|O_TRUNC|O_WRONLY,0644)) < 0)
+		panic("bench: cannot create big file");
+	for (i=0 ; i<filekb ; i++) {
+		fill(iobuf,1,i*1024UL,1024);
+		if (sys_write(fd,iobuf,1024) != 1024)
+			panic("bench: write failed");
+	}
+	sys_close(fd);
+	phase_end("write",filekb);
+
+	phase_start();
+	if ((fd = sys_open("/bench/big",O_WRONLY,0)) < 0)
+		panic("bench: cannot open big file");
+	for (i=0 ; i<filekb ; i++) {
+		fill(iobuf,1,i*1024UL,1024);
+		if (sys_write(fd,iobuf,1024) != 1024)
+			panic("bench: rewrite failed");
+	}
+	sys_close(fd);
+	phase_end("rewrite",filekb);
+
+	sys_sync();
+	phase_start();
+	if ((fd = sys_open("/bench/big",O_RDONLY,0)) < 0)
+		panic("bench: cannot open big file");
+	for (i=0 ; i<filekb ; i++) {
+		if (sys_read(fd,iobuf,1024) != 1024 ||
+		    !check(iobuf,1,i*1024UL,1024))
+			panic("bench: read back wrong data");
+	}
+	sys_close(fd);
+	phase_end("read",filekb);
+
+	phase_start();
+	if ((fd = sys_open("/bench/big",O_RDONLY,0)) < 0 ||
+	    (fd2 = sys_open("/bench/copy",O_CREAT|O_TRUNC|O_WRONLY,0644)) < 0)
+		panic("bench: cannot open files to copy");
+	while ((k = sys_read(fd,iobuf,4096)) > 0)
+		if (sys_write(fd2,iobuf,k) != k)
+			panic("bench: copy failed");
+	sys_close(fd);
+	sys_close(fd2);
+	phase_end("copy",filekb);
+
+	phase_start();
+	if ((fd = sys_open("/bench/big",O_RDONLY,0)) < 0 ||
+	    (fd2 = sys_open("/bench/copy",O_CREAT|O_TRUNC|O_WRONLY,0644)) < 0)
+		panic("bench: cannot open files to copy");
+	args[0] = fd2;
+	args[1] = fd;
+	args[2] = 0;
+	args[3] = filekb*1024;
+	if ((k = sys_sendfile(args)) != filekb*1024 && h_printf("sendfile %d\n",k))
+		panic("bench: sendfile failed");
+	sys_close(fd);
+	sys_close(fd2);
+	phase_end("sendfile",filekb);
+	if ((fd = sys_open("/bench/copy",O_RDONLY,0)) < 0)
+		panic("bench: cannot open copy");
+	for (i=0 ; i<filekb ; i++)
+		if (sys_read(fd,iobuf,1024) != 1024 ||
+		    !check(iobuf,1,i*1024UL,1024))
+			panic("bench: sendfile copied wrong data");
+	sys_close(fd);
+
+	phase_start();
+	if ((fd = sys_open("/bench/big",O_RDONLY,0)) < 0)
+		panic("bench: cannot open big file");
+	for (i=0 ; i<filekb*64 ; i++) {
+		if (sys_read(fd,iobuf,16) != 16)
+			panic("bench: short small read");
+	}
+	sys_close(fd);
+	phase_end("read16",filekb*64);
+
+	phase_start();
+	for (i=0 ; i<NR_FDS ; i++)
+		if ((fds[i] = sys_open("/bench/big",O_RDONLY,0)) != i) {
+			h_printf("fd %d: %d\n",i,fds[i]);
+			panic("bench: open did not return the lowest fd");
+		}
+	for (i=0 ; i<NR_FDS ; i+=2)
+		sys_close(fds[i]);
+	for (i=0 ; i<NR_FDS ; i+=2)
+		if (sys_open("/bench/big",O_RDONLY,0) != fds[i])
+			panic("bench: reopen did not return the lowest fd");
+	for (i=0 ; i<NR_FDS ; i++)
+		if (sys_close(fds[i]))
+			panic("bench: close failed");
+	phase_end("open",2*NR_FDS);
+
+	phase_start();
+	for (i=0 ; i<8 ; i++)
+		if (list_raw("/bench") != nfiles+4)
+			panic("bench: wrong number of entries read");
+	phase_end("readdir",8);
+
+	phase_start();
+	for (i=0 ; i<8 ; i++)
+		if (list_dents("/bench",NULL) != nfiles+4)
+			panic("bench: wrong number of entries from getdents");
+	phase_end("getdents",8);
+
+	phase_start();
+	for (i=0 ; i<nfiles ; i++)
+		if (sys_unlink(fmt_name(name,"/bench",i)))
+			panic("bench: unlink failed");
+	if (sys_unlink("/bench/big") || sys_unlink("/bench/copy"))
+		panic("bench: unlink big failed");
+	phase_end("unlink",nfiles+2);
+
+	phase_start();
+	sys_sync();
+	phase_end("sync",1);
+}
+
+/* ---- stress ---- */
+
+#define NR_SFILES 64
+
+static long ssize[NR_SFILES];		/* -1: does not exist */
+static int crash;
+
+static void stress(int ops)
+{
+	char name[64];
+	int i,n,fd,op,len,chunk;
+	unsigned long off;
+
+	sys_mkdir("/stress",0755);
+	for (i=0 ; i<NR_SFILES ; i++)
+		ssize[i] = -1;
+	phase_start();
+	for (i=0 ; i<ops ; i++) {
+		if (crash && i && !(i % 100))
+			sys_sync();
+		if (journal_wanted)		/* what system_call does */
+			journal_sync();
+		n = rnd(NR_SFILES);
+		fmt_name(name,"/stress",n);
+		op = rnd(10);
+		if (ssize[n] < 0) {
+			if ((fd = sys_open(name,O_CREAT|O_EXCL|O_WRONLY,0644)) < 0)
+				panic("stress: create failed");
+			sys_close(fd);
+			ssize[n] = 0;
+			continue;
+		}
+		if (op == 0) {
+			if (sys_unlink(name))
+				panic("stress: unlink failed");
+			ssize[n] = -1;
+		} else if (op == 1) {
+			if ((fd = sys_open(name,O_TRUNC|O_WRONLY,0)) < 0)
+				panic("stress: truncate failed");
+			sys_close(fd);
+			ssize[n] = 0;
+		} else if (op <= 5) {
+			/* write somewhere inside or just past the end */
+			off = rnd(ssize[n]+1);
+			len = rnd(op == 5 ? 300000 : 5000) + 1;
+			if ((fd = sys_open(name,O_WRONLY,0)) < 0)
+				panic("stress: open for write failed");
+			sys_lseek(fd,off,0);
+			while (len > 0) {
+				chunk = len > sizeof(iobuf) ? sizeof(iobuf) : len;
+				chunk = rnd(chunk)+1;
+				fill(iobuf,n,off,chunk);
+				if (sys_write(fd,iobuf,chunk) != chunk) {
+					h_printf("file %d off %d\n",n,off);
+					panic("stress: write failed");
+				}
+				off += chunk;
+				len -= chunk;
+			}
+			sys_close(fd);
+			if (off > ssize[n])
+				ssize[n] = off;
+		} else {
+			off = rnd(ssize[n]+1);
+			len = rnd(20000)+1;
+			if ((fd = sys_open(name,O_RDONLY,0)) < 0)
+				panic("stress: open for read failed");
+			sys_lseek(fd,off,0);
+			while (len > 0) {
+				chunk = rnd(sizeof(iobuf))+1;
+				if (chunk > len)
+					chunk = len;
+				if (off + chunk > ssize[n])
+					chunk = ssize[n] - off;
+				if (chunk <= 0)
+					break;
+				if (sys_read(fd,iobuf,chunk) != chunk ||
+				    !check(iobuf,n,off,chunk)) {
+					h_printf("file %d off %d len %d\n",n,off,chunk);
+					panic("stress: read back wrong data");
+				}
+				off += chunk;
+				len -= chunk;
+			}
+			sys_close(fd);
+		}
+	}
+	if (crash) {
+		phase_end("stress",ops);
+		h_printf("crash: %d blocks written\n",nr_block_writes);
+		h_exit(0);
+	}
+	sys_sync();
+	phase_end("stress",ops);
+}
+
+static int files;
+
+static void verify_file(char * dname)
+{
+	struct stat st;
+	char name[64];
+	int fd,n,chunk;
+	unsigned long off;
+
+	if (dname[0] != 'f')
+		return;
+	n = atoi(dname+1);
+	fmt_name(name,"/stress",n);
+	if (sys_stat(name,&st) || (fd = sys_open(name,O_RDONLY,0)) < 0)
+		panic("verify: listed file is missing");
+	for (off=0 ; off<st.st_size ; off += chunk) {
+		chunk = sizeof(iobuf);
+		if (off + chunk > st.st_size)
+			chunk = st.st_size - off;
+		if (sys_read(fd,iobuf,chunk) != chunk ||
+		    !check(iobuf,n,off,chunk)) {
+			h_printf("file %d off %d\n",n,off);
+			panic("verify: wrong data");
+		}
+	}
+	sys_close(fd);
+	files++;
+}
+
+/* check every file left in /stress against its pattern */
+static void verify(void)
+{
+	phase_start();
+	files = 0;
+	list_dents("/stress",verify_file);
+	phase_end("verify",files);
+}
+
+/* ---- journal ---- */
+
+static void mkjournal(int kb)
+{
+	int fd,i;
+
+	for (i=0 ; i<BLOCK_SIZE ; i++)
+		iobuf[i] = 0;
+	if ((fd = sys_open("/.journal",O_CREAT|O_EXCL|O_WRONLY,0600)) < 0)
+		panic("mkjournal: cannot create /.journal");
+	for (i=0 ; i<kb ; i++)
+		if (sys_write(fd,iobuf,BLOCK_SIZE) != BLOCK_SIZE)
+			panic("mkjournal: write failed");
+	sys_close(fd);
+}
+
+/* ---- tmpfs ---- */
+
+static void tmpfs_mount(char * dev, char * dir, int minor)
+{
+	sys_mknod(dev,S_IFBLK | 0600,0x800+minor);
+	sys_mkdir(dir,0755);
+	if (sys_mount(dev,dir,0))
+		panic("cannot mount tmpfs");
+}
+
+static void tmpfs_umount(char * dev)
+{
+	int err;
+
+	if ((err = sys_umount(dev)))
+		h_printf("umount %s: %d\n",dev,err);
+}
+
+int main(int argc, char ** argv)
+{
+	int bufkb = 2048;
+	int tmp = 0;
+
+	for (;;) {
+		if (argc > 2 && streq(argv[1],"-b")) {
+			bufkb = atoi(argv[2]);
+			argc -= 2;
+			argv += 2;
+		} else if (argc > 1 && streq(argv[1],"-t")) {
+			tmp = 1;
+			argc--;
+			argv++;
+		} else
+			break;
+	}
+	if (argc < 3) {
+		h_printf("usage: fsh [-b bufkb] [-t] image command [args]\n");
+		return 1;
+	}
+	harness_init(argv[1],bufkb);
+	if (tmp) {
+		tmpfs_mount("/tmpfs0","/bench",0);
+		tmpfs_mount("/tmpfs1","/stress",1);
+	}
+	if (streq(argv[2],"bench"))
+		bench(argc > 3 ? atoi(argv[3]) : 500,
+			argc > 4 ? atoi(argv[4]) : 2048);
+	else if (streq(argv[2],"stress")) {
+		if (argc > 4)
+			seed = atoi(argv[4]);
+		stress(argc > 3 ? atoi(argv[3]) : 2000);
+	} else if (streq(argv[2],"crash")) {
+		if (argc > 4)
+			seed = atoi(argv[4]);
+		crash = 1;
+		stress(argc > 3 ? atoi(argv[3]) : 2000);
+	} else if (streq(argv[2],"verify"))
+		verify();
+	else if (streq(argv[2],"mkjournal"))
+		mkjournal(argc > 3 ? atoi(argv[3]) : 512);
+	else if (!streq(argv[2],"mount")) {
+		h_printf("unknown command %s\n",argv[2]);
+		return 1;
+	}
+	phase_start();
+	sys_sync();
+	phase_end("sync",1);
+	if (tmp) {
+		tmpfs_umount("/tmpfs0");
+		tmpfs_umount("/tmpfs1");
+		h_printf("%d pages in use after umount\n",h_pages_used());
+	}
+	return 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * host.h - the few host system calls the fs harness needs. We do not
+ * link against a C library (the kernel headers would clash with it),
+ * so these go straight through int $0x80 of the i386 host ABI.
+ */
+#ifndef _HOST_H
+#define _HOST_H
+
+#define H_O_RDONLY	0
+#define H_O_RDWR	2
+
+extern int h_open(const char * name, int flags);
+extern int h_close(int fd);
+extern int h_read(int fd, void * buf, int count);
+extern int h_write(int fd, const void * buf, int count);
+extern int h_pread(int fd, void * buf, int count, unsigned long long pos);
+extern int h_pwrite(int fd, const void * buf, int count, unsigned long long pos);
+extern void * h_mmap(void * addr, unsigned long len);
+extern void h_exit(int code) __attribute__((noreturn));
+extern unsigned long long h_usecs(void);
+extern int h_printf(const char * fmt, ...);
+
+/* block I/O counters, kept by the ll_rw_block() shim */
+extern unsigned long nr_block_reads, nr_block_writes;
+
+extern void harness_init(const char * image, int nr_buffer_kb);
+extern int h_pages_used(void);
+
+#endif
@@ -0,0 +1,13 @@
+/*
+ * Host replacement for <asm/system.h>: the harness runs the fs code as
+ * an ordinary single-threaded user process, so there is nothing to
+ * mask and no descriptor tables to touch.
+ */
+#ifndef _HARNESS_SYSTEM_H
+#define _HARNESS_SYSTEM_H
+
+#define sti() do { } while (0)
+#define cli() do { } while (0)
+#define nop() do { } while (0)
+
+#endif
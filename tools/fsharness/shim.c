@@ -0,0 +1,303 @@
+/*
+ *  tools/fsharness/shim.c
+ *
+ * Everything the fs/ code expects from the rest of the kernel, done
+ * the simple way for a single-threaded host process: the block device
+ * is an image file read and written synchronously, sleeping never
+ * happens (nothing is ever left locked), and pages come from a static
+ * pool.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/tty.h>
+
+#include "host.h"
+
+extern int vsprintf(char * buf, const char * fmt, va_list args);
+
+/* ---- host system calls (i386 int $0x80 ABI) ---- */
+
+#define __NR_exit	1
+#define __NR_read	3
+#define __NR_write	4
+#define __NR_open	5
+#define __NR_close	6
+#define __NR__llseek	140
+#define __NR_mmap2	192
+#define __NR_clock_gettime 265
+
+/* the sixth argument (%ebp) is always zero for the calls we make */
+static long hsys(long nr, long a, long b, long c, long d, long e)
+{
+	long res;
+
+	__asm__ volatile ("push %%ebp\n\t"
+		"xorl %%ebp,%%ebp\n\t"
+		"int $0x80\n\t"
+		"pop %%ebp"
+		:"=a" (res)
+		:"0" (nr),"b" (a),"c" (b),"d" (c),"S" (d),"D" (e)
+		:"memory");
+	return res;
+}
+
+int h_open(const char * name, int flags)
+{
+	return hsys(__NR_open,(long) name,flags,0644,0,0);
+}
+
+int h_close(int fd)
+{
+	return hsys(__NR_close,fd,0,0,0,0);
+}
+
+int h_read(int fd, void * buf, int count)
+{
+	return hsys(__NR_read,fd,(long) buf,count,0,0);
+}
+
+int h_write(int fd, const void * buf, int count)
+{
+	return hsys(__NR_write,fd,(long) buf,count,0,0);
+}
+
+static int h_seek(int fd, unsigned long long pos)
+{
+	unsigned long long res;
+
+	return hsys(__NR__llseek,fd,(long) (pos>>32),(long) pos,
+		(long) &res,0);
+}
+
+int h_pread(int fd, void * buf, int count, unsigned long long pos)
+{
+	if (h_seek(fd,pos) < 0)
+		return -1;
+	return h_read(fd,buf,count);
+}
+
+int h_pwrite(int fd, const void * buf, int count, unsigned long long pos)
+{
+	if (h_seek(fd,pos) < 0)
+		return -1;
+	return h_write(fd,buf,count);
+}
+
+void * h_mmap(void * addr, unsigned long len)
+{
+	/* PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED */
+	return (void *) hsys(__NR_mmap2,(long) addr,len,3,0x32,-1);
+}
+
+void h_exit(int code)
+{
+	for (;;)
+		hsys(__NR_exit,code,0,0,0,0);
+}
+
+unsigned long long h_usecs(void)
+{
+	long ts[2];
+
+	hsys(__NR_clock_gettime,1,(long) ts,0,0,0);	/* CLOCK_MONOTONIC */
+	return ts[0]*1000000ULL + ts[1]/1000;
+}
+
+static char hbuf[1024];
+
+int h_printf(const char * fmt, ...)
+{
+	va_list args;
+	int i;
+
+	va_start(args, fmt);
+	i = vsprintf(hbuf,fmt,args);
+	va_end(args);
+	return h_write(1,hbuf,i);
+}
+
+/* ---- kernel state the fs code refers to ---- */
+
+static struct task_struct harness_task;
+struct task_struct * current = &harness_task;
+struct task_struct * task[NR_TASKS] = { &harness_task, };
+long volatile jiffies = 0;
+long startup_time = 0;
+struct tty_struct tty_table[3];
+
+unsigned long nr_block_reads, nr_block_writes;
+static int image_fd = -1;
+
+void ll_rw_block(int rw, struct buffer_head * bh)
+{
+	unsigned long long pos = bh->b_blocknr * (unsigned long long) BLOCK_SIZE;
+
+	jiffies++;
+	if (rw == READ || rw == READA) {
+		if (h_pread(image_fd,bh->b_data,BLOCK_SIZE,pos) != BLOCK_SIZE)
+			return;
+		nr_block_reads++;
+		bh->b_uptodate = 1;
+	} else {
+		if (h_pwrite(image_fd,bh->b_data,BLOCK_SIZE,pos) != BLOCK_SIZE)
+			panic("harness: short write to image");
+		nr_block_writes++;
+		bh->b_uptodate = 1;
+		bh->b_dirt = 0;
+	}
+}
+
+void sleep_on(struct task_struct ** p)
+{
+	panic("harness: sleep_on with a single task");
+}
+
+void interruptible_sleep_on(struct task_struct ** p)
+{
+	sleep_on(p);
+}
+
+void wake_up(struct task_struct ** p)
+{
+	if (p)
+		*p = NULL;
+}
+
+void schedule(void)
+{
+}
+
+void panic(const char * s)
+{
+	h_printf("Kernel panic: %s\n",s);
+	h_exit(3);
+}
+
+int tty_write(unsigned ch, char * buf, int count)
+{
+	return h_write(2,buf,count);
+}
+
+int printk(const char * fmt, ...)
+{
+	va_list args;
+	int i;
+
+	va_start(args, fmt);
+	i = vsprintf(hbuf,fmt,args);
+	va_end(args);
+	return h_write(2,hbuf,i);
+}
+
+void verify_area(void * addr, int count)
+{
+}
+
+int floppy_change(unsigned int nr)
+{
+	return 0;
+}
+
+void wait_for_keypress(void)
+{
+}
+
+int rw_char(int rw, int dev, char * buf, int count, off_t * pos)
+{
+	return -1;
+}
+
+int tty_ioctl(int dev, int cmd, int arg)
+{
+	return -1;
+}
+
+/* ---- pages ---- */
+
+#define NR_HPAGES 4096
+
+static char page_pool[NR_HPAGES][PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static unsigned char page_used[NR_HPAGES];
+
+unsigned long get_free_page(void)
+{
+	int i;
+
+	for (i=0 ; i<NR_HPAGES ; i++)
+		if (!page_used[i]) {
+			page_used[i] = 1;
+			memset(page_pool[i],0,PAGE_SIZE);
+			return (unsigned long) page_pool[i];
+		}
+	return 0;
+}
+
+int h_pages_used(void)
+{
+	int i,n = 0;
+
+	for (i=0 ; i<NR_HPAGES ; i++)
+		n += page_used[i];
+	return n;
+}
+
+void free_page(unsigned long addr)
+{
+	int i = (addr - (unsigned long) page_pool) / PAGE_SIZE;
+
+	if (i < 0 || i >= NR_HPAGES || !page_used[i])
+		panic("harness: trying to free free page");
+	page_used[i] = 0;
+}
+
+/* malloc() hands out whole pages: the fs code only asks for small tables */
+void * malloc(unsigned int size)
+{
+	if (size > PAGE_SIZE)
+		panic("harness: malloc too big");
+	return (void *) get_free_page();
+}
+
+void free_s(void * obj, int size)
+{
+	free_page((unsigned long) obj);
+}
+
+/* ---- start-up ---- */
+
+extern int end;
+
+void harness_init(const char * image, int nr_buffer_kb)
+{
+	unsigned long start = ((unsigned long) &end + 4095) & ~4095;
+	unsigned long buffer_end = start + nr_buffer_kb*1024;
+	unsigned short ds;
+	long ts[2];
+
+	/* the fs code reaches "user" memory through %fs: make that us */
+	__asm__("mov %%ds,%0":"=r" (ds));
+	__asm__("mov %0,%%fs"::"r" (ds));
+	if ((image_fd = h_open(image,H_O_RDWR)) < 0) {
+		h_printf("cannot open %s\n",image);
+		h_exit(2);
+	}
+	if (h_mmap((void *) start,buffer_end-start) != (void *) start) {
+		h_printf("cannot map buffer memory\n");
+		h_exit(2);
+	}
+	hsys(__NR_clock_gettime,0,(long) ts,0,0,0);	/* CLOCK_REALTIME */
+	startup_time = ts[0];
+	current->umask = 0022;
+	current->tty = -1;
+	current->filp = current->fd_array;
+	current->open_fds = current->fd_bits;
+	current->close_on_exec = current->fd_bits+1;
+	current->max_fds = NR_OPEN;
+	buffer_init(buffer_end);
+	ROOT_DEV = 0x301;
+	mount_root();
+}